@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <yara/buffers.hxx>
+#include <yara/entitys.hxx>
+
+namespace yara
+{
+    /**
+     * @brief walks zip, gzip and tar containers held in memory, nested
+     * ones included, and hands every member to a visitor without writing
+     * anything to disk. Members are named parent!member
+     */
+    class Archive
+    {
+    public:
+        enum class Format
+        {
+            None,
+            Zip,
+            Gzip,
+            Tar
+        };
+
+        /* path, data, size, error. Data may hold a partial member when
+         * error is set, and is empty when the member was refused */
+        using Visit = std::function<void(
+            const std::string &, const uint8_t *, size_t, const std::string &)>;
+
+        Archive(const yara::type::ArchiveLimits &, yara::Buffers &);
+        ~Archive() = default;
+
+        /* false if the data is not a container that could be parsed */
+        [[nodiscard]] const bool walk(const std::string &,
+                        const uint8_t *,
+                        size_t,
+                        const Visit &);
+
+        [[nodiscard]] static Format detect(const uint8_t *, size_t);
+
+    private:
+        const yara::type::ArchiveLimits limits_;
+        yara::Buffers &buffers_;
+        size_t members_;
+        size_t expanded_;
+        bool stopped_;
+
+        [[nodiscard]] const bool walk_node(const std::string &,
+                                           const uint8_t *,
+                                           size_t,
+                                           Format,
+                                           size_t,
+                                           const Visit &);
+        [[nodiscard]] const bool walk_zip(const std::string &,
+                                          const uint8_t *,
+                                          size_t,
+                                          size_t,
+                                          const Visit &);
+        [[nodiscard]] const bool walk_tar(const std::string &,
+                                          const uint8_t *,
+                                          size_t,
+                                          size_t,
+                                          const Visit &);
+        [[nodiscard]] const bool walk_gzip(const std::string &,
+                                           const uint8_t *,
+                                           size_t,
+                                           size_t,
+                                           const Visit &);
+
+        void decoded(const std::string &,
+                     yara::Buffer &,
+                     const std::string &,
+                     size_t,
+                     const Visit &);
+        void member(const std::string &,
+                    const uint8_t *,
+                    size_t,
+                    size_t,
+                    const Visit &);
+        [[nodiscard]] const bool admit(const std::string &, const Visit &);
+        [[nodiscard]] const bool inflate(const uint8_t *,
+                                         size_t,
+                                         bool,
+                                         yara::Buffer &,
+                                         std::string &,
+                                         std::string &);
+
+        Archive(const Archive &) = delete;
+        Archive &operator=(const Archive &) = delete;
+    };
+} // namespace yara
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include <yara.h>
+
+extern "C"
+{
+    /* one block of a logical input, base is its offset in that input */
+    struct yaral_block
+    {
+        const uint8_t *data;
+        size_t size;
+        uint64_t base;
+    };
+
+    /**
+     * blocks handed out lazily by a native producer. next fills the
+     * following block and returns 1, returns 0 once there are no more and
+     * a negative value on failure. Block data stays valid until the scan
+     * returns for the first block (modules read it again after the last
+     * one) and until the following call to next for the others
+     */
+    struct yaral_block_source
+    {
+        void *user_data;
+        int (*next)(void *user_data, struct yaral_block *block);
+        /* size of the whole input, seen as filesize. May be NULL */
+        uint64_t (*size)(void *user_data);
+    };
+}
+
+namespace yara
+{
+    namespace blocks
+    {
+        /**
+         * @brief YR_MEMORY_BLOCK_ITERATOR over buffers owned by the caller,
+         * scanned as one input without joining them
+         */
+        class Chunks
+        {
+        public:
+            explicit Chunks(const std::vector<std::string_view> &);
+            ~Chunks() = default;
+
+            [[nodiscard]] YR_MEMORY_BLOCK_ITERATOR &get();
+            [[nodiscard]] const uint64_t size() const;
+
+        private:
+            std::vector<std::string_view> chunks_;
+            std::vector<uint64_t> bases_;
+            uint64_t size_;
+            size_t index_;
+            YR_MEMORY_BLOCK block_;
+            YR_MEMORY_BLOCK_ITERATOR iterator_;
+
+            [[nodiscard]] YR_MEMORY_BLOCK *at(size_t);
+
+            static YR_MEMORY_BLOCK *first(YR_MEMORY_BLOCK_ITERATOR *);
+            static YR_MEMORY_BLOCK *next(YR_MEMORY_BLOCK_ITERATOR *);
+            static uint64_t file_size(YR_MEMORY_BLOCK_ITERATOR *);
+        };
+
+        /**
+         * @brief YR_MEMORY_BLOCK_ITERATOR pulling blocks from a
+         * yaral_block_source as libyara asks for them
+         */
+        class Source
+        {
+        public:
+            explicit Source(const yaral_block_source &);
+            ~Source() = default;
+
+            [[nodiscard]] YR_MEMORY_BLOCK_ITERATOR &get();
+
+        private:
+            const yaral_block_source source_;
+            bool started_;
+            YR_MEMORY_BLOCK first_;
+            YR_MEMORY_BLOCK current_;
+            YR_MEMORY_BLOCK_ITERATOR iterator_;
+
+            [[nodiscard]] YR_MEMORY_BLOCK *pull(YR_MEMORY_BLOCK &);
+
+            static YR_MEMORY_BLOCK *first(YR_MEMORY_BLOCK_ITERATOR *);
+            static YR_MEMORY_BLOCK *next(YR_MEMORY_BLOCK_ITERATOR *);
+            static uint64_t file_size(YR_MEMORY_BLOCK_ITERATOR *);
+        };
+    } // namespace blocks
+} // namespace yara
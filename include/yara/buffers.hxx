@@ -0,0 +1,61 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace yara
+{
+    /* uninitialized byte buffer handed out by Buffers */
+    struct Buffer
+    {
+        std::unique_ptr<uint8_t[]> data;
+        size_t capacity = 0;
+        size_t size = 0;
+    };
+
+    /**
+     * @brief pool of reusable byte buffers. Idle buffers are kept up to a
+     * number of bytes, and an optional budget bounds the bytes the pool
+     * owns, handed out and idle together
+     */
+    class Buffers
+    {
+    public:
+        explicit Buffers(size_t /* max idle bytes */,
+                         size_t /* budget, 0 is unbounded */ = 0);
+        ~Buffers() = default;
+
+        /* never waits, the budget is not checked */
+        [[nodiscard]] Buffer acquire(size_t);
+        /* within the budget, dropping idle buffers to make room. Waits for
+         * releases when asked to, empty when it would have to wait
+         * otherwise or once closed. A buffer bigger than the budget is
+         * handed out once nothing else is */
+        [[nodiscard]] std::optional<Buffer> reserve(size_t, bool /* wait */);
+        void release(Buffer &&);
+        /* wake and fail reserve calls waiting for the budget */
+        void close();
+
+    private:
+        const size_t max_idle_;
+        const size_t budget_;
+        std::mutex mutex_;
+        std::condition_variable released_;
+        std::vector<Buffer> idle_;
+        size_t idle_bytes_;
+        /* capacity of the buffers handed out */
+        size_t live_bytes_;
+        bool closed_;
+
+        [[nodiscard]] Buffer take_locked(size_t);
+        [[nodiscard]] const bool fits_locked(size_t);
+
+        Buffers(const Buffers &) = delete;
+        Buffers &operator=(const Buffers &) = delete;
+    };
+} // namespace yara
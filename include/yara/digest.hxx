@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct evp_md_ctx_st;
+struct fuzzy_state;
+
+namespace yara
+{
+    /* digest name to its text form */
+    using DigestMap = std::map<std::string, std::string>;
+
+    /**
+     * @brief incremental MD5, SHA-1 and SHA-256 through OpenSSL, and
+     * ssdeep through libfuzzy, over one input. Asking for a digest the
+     * library was built without throws
+     */
+    class Digests
+    {
+    public:
+        /* inputs from this size on are hashed next to the scan */
+        static constexpr size_t OVERLAP = 1 << 20;
+
+        explicit Digests(uint32_t /* type::Digest mask */);
+        ~Digests();
+
+        void update(const uint8_t *, size_t);
+        [[nodiscard]] DigestMap finish();
+
+        /* digests of a whole buffer, computed on a second thread when it
+         * is at least OVERLAP bytes, or when the future is read otherwise.
+         * The buffer must outlive the future */
+        [[nodiscard]] static std::future<DigestMap>
+        start(uint32_t, const uint8_t *, size_t);
+        /* same, for an input split over several buffers */
+        [[nodiscard]] static std::future<DigestMap>
+        start(uint32_t, const std::vector<std::string_view> &);
+
+    private:
+        static constexpr size_t EVP = 3;
+
+        evp_md_ctx_st *contexts_[EVP];
+        fuzzy_state *fuzzy_;
+
+        void release();
+
+        Digests(const Digests &) = delete;
+        Digests &operator=(const Digests &) = delete;
+    };
+} // namespace yara
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <yara/entitys.hxx>
+
+namespace yara
+{
+    struct EmitterOptions
+    {
+        yara::type::Emit format = yara::type::Emit::JsonLines;
+        /* records are buffered until this many bytes, then written */
+        size_t batch = 64 << 10;
+        /* rotate a file target past this size, 0 never rotates */
+        size_t rotate = 0;
+        /* rotated files kept as path.1 .. path.keep */
+        size_t keep = 4;
+    };
+
+    struct EmitterStats
+    {
+        uint64_t records = 0;
+        uint64_t bytes = 0;
+        uint64_t writes = 0;
+        uint64_t rotations = 0;
+        /* records dropped because a write failed */
+        uint64_t dropped = 0;
+    };
+
+    /**
+     * @brief writes scan results as JSON Lines or length prefixed binary
+     * records to a file descriptor or a rotating file. Records are
+     * encoded by the scanning thread and written in batches
+     */
+    class Emitter
+    {
+    public:
+        /* the descriptor stays owned by the caller */
+        explicit Emitter(int, const EmitterOptions & = {});
+        explicit Emitter(const std::string &, const EmitterOptions & = {});
+        ~Emitter();
+
+        void emit(const yara::type::ScanResult &);
+        void flush();
+        [[nodiscard]] EmitterStats stats() const;
+
+    private:
+        const EmitterOptions options_;
+        const std::string path_;
+        int fd_;
+        bool owned_;
+        size_t file_bytes_;
+        size_t pending_records_;
+
+        mutable std::mutex mutex_;
+        std::string batch_;
+        EmitterStats stats_;
+
+        static void encode_json(std::string &,
+                                const yara::type::ScanResult &);
+        static void encode_binary(std::string &,
+                                  const yara::type::ScanResult &);
+
+        void open_locked();
+        void rotate_locked();
+        void flush_locked();
+
+        Emitter(const Emitter &) = delete;
+        Emitter &operator=(const Emitter &) = delete;
+    };
+} // namespace yara
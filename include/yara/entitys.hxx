@@ -1,10 +1,18 @@
 #pragma once
 
+#include <map>
+#include <memory>
 #include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <variant>
 #include <yara.h>
 
 namespace yara
 {
+    class Emitter;
+
     namespace type
     {
         enum Flags
@@ -31,7 +39,217 @@ namespace yara
             ReportRulesMatching = SCAN_FLAGS_REPORT_RULES_MATCHING,
             ReportRulesNotMatching = SCAN_FLAGS_REPORT_RULES_NOT_MATCHING
         };
+        /* events reported by background compiles */
+        enum Compile
+        {
+            Progress,
+            Warning,
+            Error,
+            Installed,
+            Failed
+        };
+        /* record formats written by Emitter */
+        enum Emit
+        {
+            JsonLines,
+            Binary
+        };
+        /* digests computed over the scanned data, combined as a mask */
+        enum Digest
+        {
+            Md5 = 1,
+            Sha1 = 2,
+            Sha256 = 4,
+            Ssdeep = 8
+        };
+        /* scheduler lanes, Auto picks Fast or Bulk from the input size */
+        enum Lane
+        {
+            Fast,
+            Bulk,
+            Priority,
+            Auto
+        };
+        /* what a bulk rule toggle selects rules by */
+        enum RuleKey
+        {
+            Identifier,
+            Tag,
+            Namespace
+        };
+
         using Rule = YR_RULE;
         using Match = YR_MATCH;
+        /* compiled rules, shared between instances by the registry */
+        using Rules = std::shared_ptr<YR_RULES>;
+
+        /* bulk enable or disable, replayed on every rules reload */
+        struct RuleToggle
+        {
+            RuleKey key = Identifier;
+            std::string name;
+            bool disabled = false;
+        };
+
+        struct RegistryEntry
+        {
+            std::string name;
+            uint64_t version = 0;
+            size_t bytes = 0;
+            /* instances holding the rules besides the registry */
+            long attached = 0;
+        };
+
+        /* value of an external variable, coerced to the declared type */
+        using External = std::variant<bool, int64_t, double, std::string>;
+        using Externals = std::unordered_map<std::string, External>;
+
+        /* module data blob, shared between scans without copies */
+        using ModuleData = std::shared_ptr<const std::string>;
+
+        struct ModuleStats
+        {
+            uint64_t imports = 0;
+            uint64_t denied = 0;
+            uint64_t supplied = 0;
+            /* time spent loading allowed and denied imports */
+            uint64_t load_ns = 0;
+            uint64_t denied_load_ns = 0;
+        };
+
+        struct RuleSource
+        {
+            /* rule file or folder, folders follow set_rules_folder */
+            std::string path;
+            /* rule text, used when path is empty */
+            std::string buffer;
+            std::string ns;
+        };
+
+        struct CompileEvent
+        {
+            Compile type;
+            std::string file;
+            int line = 0;
+            std::string message;
+            size_t done = 0;
+            size_t total = 0;
+            /* rule the warning or error refers to, when libyara knows */
+            std::string rule;
+        };
+
+        struct MatchedMeta
+        {
+            std::string identifier;
+            std::variant<bool, int64_t, std::string> value;
+        };
+
+        struct MatchedString
+        {
+            std::string identifier;
+            uint64_t offset = 0;
+            uint32_t length = 0;
+        };
+
+        struct RuleMatch
+        {
+            std::string identifier;
+            std::string ns;
+            /* filled only for detailed results */
+            std::vector<std::string> tags;
+            std::vector<MatchedMeta> metas;
+            std::vector<MatchedString> strings;
+        };
+
+        /* stop reporting rules once the verdict is known, 0 and empty
+         * fields are off */
+        struct ExitPolicy
+        {
+            /* matching rules before the scan stops, 1 is the first match */
+            size_t matches = 0;
+            /* a matching rule with this tag stops the scan */
+            std::string tag;
+            /* a matching rule with this meta stops the scan when it is an
+             * integer/boolean of at least meta_min, or a string equal to
+             * meta_value. An empty meta_value accepts "true", "yes" and
+             * "1", in any case */
+            std::string meta;
+            int64_t meta_min = 1;
+            std::string meta_value;
+        };
+
+        struct ExitReport
+        {
+            /* a policy stopped the scan */
+            bool stopped = false;
+            /* "namespace:identifier" of the rule that stopped it */
+            std::string rule;
+            uint32_t matched = 0;
+            /* rules reported before the stop, and the ones never reported */
+            uint32_t reported = 0;
+            uint32_t skipped = 0;
+            uint32_t total = 0;
+        };
+
+        /* verdict collected natively, no Lua involved */
+        struct ScanResult
+        {
+            std::string path;
+            /* empty when the scan succeeded */
+            std::string error;
+            std::vector<RuleMatch> matches;
+            /* collect tags, metas and string offsets as well */
+            bool detailed = false;
+            ExitReport exit;
+            /* digest name to lowercase hex, or ssdeep text */
+            std::map<std::string, std::string> digests;
+        };
+
+        struct BulkOptions
+        {
+            /* scanning threads, 0 uses every core */
+            size_t threads = 0;
+            /* reads kept in flight ahead of the scanners */
+            size_t depth = 32;
+            /* bigger files are scanned from disk, not prefetched */
+            size_t max_size = 256 << 20;
+            /* bytes of prefetched files held at once, read, queued or
+             * being scanned, 0 is unbounded. A file bigger than this is
+             * read once nothing else is held */
+            size_t max_inflight_bytes = 1ull << 30;
+        };
+
+        struct ArchiveLimits
+        {
+            /* nested containers, the outer one is depth 1 */
+            size_t depth = 4;
+            /* members visited across every nesting level */
+            size_t members = 10000;
+            /* bytes decompressed across every member */
+            size_t expanded = 1ull << 30;
+            /* largest single member once decompressed */
+            size_t member_size = 256 << 20;
+            /* decompressed to compressed size, checked past 1 MiB of
+             * output, 0 disables the check */
+            size_t ratio = 1000;
+        };
+
+        struct ScanOptions
+        {
+            /* overrides applied to this scan only */
+            Externals externals;
+            /* scan class looked up in the module policy */
+            std::string scan_class;
+            /* module data for this scan, wins over the policy data */
+            std::unordered_map<std::string, ModuleData> module_data;
+            /* every scan writes its result here, bulk scans instead of
+             * Lua */
+            std::shared_ptr<yara::Emitter> emitter;
+            /* path of the emitted result for inputs that are not files */
+            std::string name;
+            ExitPolicy exit;
+            /* Digest mask, hashed from the same bytes the scan reads */
+            uint32_t digests = 0;
+        };
     } // namespace type
 } // namespace yara
@@ -67,5 +67,25 @@ namespace yara
       const char *what() const noexcept override;
     };
 
+    class Registry : public interface::IException
+    {
+    private:
+      const std::string error_message_;
+
+    public:
+      explicit Registry(const std::string &);
+      const char *what() const noexcept override;
+    };
+
+    class Ring : public interface::IException
+    {
+    private:
+      const std::string error_message_;
+
+    public:
+      explicit Ring(const std::string &);
+      const char *what() const noexcept override;
+    };
+
   } // namespace exception
 } // namespace yara
@@ -23,6 +23,11 @@ namespace yara::extend
     inline void bind_meta();
     inline void bind_rule();
     inline void bind_stream();
+    inline void bind_module_data();
+    inline void bind_registry();
+    inline void bind_emitter();
     inline void bind_yara();
+    inline void bind_scheduler();
+    inline void bind_ingest();
   };
 } // namespace yara::extend
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <yara.h>
+#include <yara/entitys.hxx>
+
+namespace yara
+{
+    /**
+     * @brief hash index of a rules table by identifier, tag and namespace,
+     * built once per load. Identifiers are indexed bare, matching every
+     * namespace, and as "namespace:identifier"
+     */
+    class RuleIndex
+    {
+    public:
+        explicit RuleIndex(YR_RULES *);
+        ~RuleIndex() = default;
+
+        /* rules in table order, empty when nothing is indexed under it */
+        [[nodiscard]] const std::vector<YR_RULE *> &
+        find(yara::type::RuleKey, const std::string &) const;
+
+    private:
+        using Map = std::unordered_map<std::string, std::vector<YR_RULE *>>;
+
+        std::array<Map, 3> maps_;
+
+        RuleIndex(const RuleIndex &) = delete;
+        RuleIndex &operator=(const RuleIndex &) = delete;
+    };
+} // namespace yara
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <yara/entitys.hxx>
+#include <yara/latency.hxx>
+#include <yara/ring.hxx>
+
+namespace yara
+{
+    class Yara;
+
+    struct IngestOptions
+    {
+        /* scanning threads */
+        size_t threads = 1;
+        /* create the ring, otherwise attach to one a producer made */
+        bool create = true;
+        uint32_t slots = 256;
+        size_t slot_size = 1 << 20;
+    };
+
+    struct IngestStats
+    {
+        uint64_t scanned = 0;
+        uint64_t failed = 0;
+        /* slots with at least one matching rule */
+        uint64_t matched = 0;
+        LatencyReport service;
+    };
+
+    /**
+     * @brief scans the slots of a shared memory Ring in place with a pool
+     * of workers and writes the verdicts back to it. Idle workers spin,
+     * then yield, then back off to short sleeps, so an empty ring costs
+     * close to nothing and a busy one never blocks on a syscall
+     */
+    class Ingest
+    {
+    public:
+        Ingest(const yara::Yara &,
+               const std::string & /* ring name */,
+               yara::type::Flags,
+               const IngestOptions & = {},
+               const yara::type::ScanOptions & = {});
+        ~Ingest();
+
+        [[nodiscard]] const yara::Ring &ring() const;
+        [[nodiscard]] IngestStats stats() const;
+        /* workers finish the slot they hold and exit */
+        void stop();
+
+    private:
+        const yara::Yara &yara_;
+        const yara::type::Flags flags_;
+        const yara::type::ScanOptions options_;
+        const std::shared_ptr<yara::Emitter> emitter_;
+        std::unique_ptr<yara::Ring> ring_;
+
+        std::atomic<bool> stopping_;
+        std::atomic<uint64_t> scanned_;
+        std::atomic<uint64_t> failed_;
+        std::atomic<uint64_t> matched_;
+        yara::Latency service_;
+        std::vector<std::thread> workers_;
+
+        void work();
+        void scan(uint32_t);
+
+        Ingest(const Ingest &) = delete;
+        Ingest &operator=(const Ingest &) = delete;
+    };
+} // namespace yara
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace yara
+{
+    struct LatencyReport
+    {
+        uint64_t count = 0;
+        double seconds = 0;
+        double per_second = 0;
+        uint64_t p50_ns = 0;
+        uint64_t p90_ns = 0;
+        uint64_t p99_ns = 0;
+        uint64_t p999_ns = 0;
+        uint64_t max_ns = 0;
+    };
+
+    /**
+     * @brief lock free latency histogram with power of two buckets,
+     * percentiles are reported as the upper bound of their bucket
+     */
+    class Latency
+    {
+    public:
+        Latency();
+        ~Latency() = default;
+
+        void record(uint64_t /* nanoseconds */);
+        void reset();
+        [[nodiscard]] LatencyReport report() const;
+
+    private:
+        static constexpr size_t BUCKETS = 64;
+
+        std::array<std::atomic<uint64_t>, BUCKETS> buckets_;
+        std::atomic<uint64_t> count_;
+        std::atomic<uint64_t> max_;
+        mutable std::mutex since_mutex_;
+        std::chrono::steady_clock::time_point since_;
+
+        Latency(const Latency &) = delete;
+        Latency &operator=(const Latency &) = delete;
+    };
+} // namespace yara
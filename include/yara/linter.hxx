@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <yara.h>
+#include <yara/entitys.hxx>
+
+namespace yara
+{
+    struct LintOptions
+    {
+        /* strings whose best atom scores below this are flagged */
+        int min_quality = 40;
+        /* hex jumps wider than this are flagged */
+        size_t max_jump = 200;
+        /* rules with more atoms are flagged, 0 disables the check */
+        size_t max_atoms = 0;
+    };
+
+    struct LintString
+    {
+        std::string identifier;
+        /* text, hex or regex */
+        std::string kind;
+        /* longest run of fixed bytes, atoms are taken from it */
+        size_t atom = 0;
+        /* 0 to 100, how rare the best atom of the string is */
+        int quality = 0;
+        std::vector<std::string> issues;
+    };
+
+    struct LintRule
+    {
+        std::string identifier;
+        std::string ns;
+        int32_t atoms = 0;
+        /* atoms plus the quality lost by every string plus warnings */
+        uint64_t cost = 0;
+        std::vector<LintString> strings;
+        std::vector<std::string> issues;
+        bool flagged = false;
+    };
+
+    /* compiler warning or error split into fields */
+    struct LintDiagnostic
+    {
+        bool error = false;
+        std::string file;
+        int line = 0;
+        std::string rule;
+        std::string string;
+        std::string message;
+        /* a "may slow down scanning" warning */
+        bool slow = false;
+    };
+
+    struct LintReport
+    {
+        /* false when the sources did not compile */
+        bool compiled = false;
+        size_t flagged = 0;
+        std::vector<LintRule> rules;
+        std::vector<LintDiagnostic> diagnostics;
+    };
+
+    /**
+     * @brief static cost analysis of compiled rules: atom counts, atom
+     * quality of every string, slow hex jumps and regexes, and the
+     * compiler warnings parsed into fields. Compiled rules keep no text
+     * of hex and regex strings, those are read from the parser tree
+     */
+    class Linter
+    {
+    public:
+        explicit Linter(const LintOptions & = {});
+        ~Linter() = default;
+
+        /* records hex and regex strings as the compiler parses them */
+        void attach(YR_COMPILER *);
+        void diagnostic(const yara::type::CompileEvent &);
+        /* rules may be null when the compile failed */
+        [[nodiscard]] LintReport report(YR_RULES *);
+
+        /* one line per rule, worst first, then the diagnostics */
+        [[nodiscard]] static std::string dump(const LintReport &);
+
+        /* quality of the best atom found in bytes */
+        [[nodiscard]] static int quality(std::string_view, bool /* nocase */);
+
+    private:
+        /* a repeat of the parser tree, end is RE_MAX_RANGE when unbounded */
+        struct Repeat
+        {
+            /* '*', '+', or '{' for counted repeats and hex jumps */
+            char op;
+            /* repeats any byte rather than fixed ones */
+            bool wildcard;
+            int start;
+            int end;
+        };
+
+        /* a hex or regex string as the parser saw it */
+        struct Shape
+        {
+            std::string identifier;
+            /* runs of fixed bytes, atoms are taken from them */
+            std::vector<std::string> runs;
+            std::vector<Repeat> repeats;
+        };
+
+        const LintOptions options_;
+        std::vector<LintDiagnostic> diagnostics_;
+        /* "namespace:rule" to its shapes, in declaration order */
+        std::unordered_map<std::string, std::vector<Shape>> shapes_;
+
+        static void parsed(const YR_RULE *,
+                           const char *,
+                           const RE_AST *,
+                           void *);
+        static void walk(const RE_NODE *, Shape &, std::string &);
+
+        [[nodiscard]] LintString lint_string(const YR_STRING *,
+                                             const Shape *) const;
+    };
+} // namespace yara
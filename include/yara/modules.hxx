@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <yara/entitys.hxx>
+
+namespace yara
+{
+    /**
+     * @brief native policy answering CALLBACK_MSG_IMPORT_MODULE, modules
+     * denied for a scan class get no data and never reach Lua
+     */
+    class Modules
+    {
+    public:
+        Modules() = default;
+        ~Modules() = default;
+
+        void deny(const std::string & /* scan class */,
+                  const std::string & /* module */);
+        void allow(const std::string & /* scan class */,
+                   const std::string & /* module */);
+
+        /* data handed to every import of the module, empty clears it */
+        void set_data(const std::string &, yara::type::ModuleData);
+
+        [[nodiscard]] const bool denied(const std::string &,
+                                        const char *) const;
+        [[nodiscard]] yara::type::ModuleData data(const char *) const;
+
+        void record(const char *, bool, bool, uint64_t) const;
+        [[nodiscard]] std::unordered_map<std::string,
+                                         yara::type::ModuleStats>
+        stats() const;
+
+    private:
+        mutable std::shared_mutex policy_mutex_;
+        std::unordered_map<std::string, std::unordered_set<std::string>>
+            denied_;
+        std::unordered_map<std::string, yara::type::ModuleData> data_;
+
+        mutable std::mutex stats_mutex_;
+        mutable std::unordered_map<std::string, yara::type::ModuleStats>
+            stats_;
+
+        Modules(const Modules &) = delete;
+        Modules &operator=(const Modules &) = delete;
+    };
+} // namespace yara
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <yara/buffers.hxx>
+#include <yara/queue.hxx>
+
+namespace yara
+{
+    /* file read ahead by Prefetch, index is its position in the list */
+    struct Loaded
+    {
+        size_t index = 0;
+        Buffer buffer;
+        int error = 0;
+        /* bigger than the prefetch limit, scan it from disk instead */
+        bool oversized = false;
+    };
+
+    /**
+     * @brief reads a list of files ahead of the scanners, keeping up to
+     * depth reads in flight through io_uring, or through a pread thread
+     * pool when io_uring is not available
+     */
+    class Prefetch
+    {
+    public:
+        Prefetch(const std::vector<std::string> &,
+                 size_t /* depth */,
+                 size_t /* max file size */,
+                 yara::Buffers &,
+                 yara::Queue<Loaded> &);
+        ~Prefetch();
+
+        [[nodiscard]] const bool uring() const;
+
+    private:
+        const std::vector<std::string> &paths_;
+        const size_t depth_;
+        const size_t max_size_;
+        yara::Buffers &buffers_;
+        yara::Queue<Loaded> &out_;
+
+        std::atomic<bool> uring_;
+        std::atomic<size_t> next_;
+        std::vector<std::thread> threads_;
+
+        void run();
+        [[nodiscard]] const bool run_uring();
+        void run_pread();
+        [[nodiscard]] const bool open(size_t, int &, size_t &);
+        [[nodiscard]] const bool emit(Loaded &&);
+
+        Prefetch(const Prefetch &) = delete;
+        Prefetch &operator=(const Prefetch &) = delete;
+    };
+} // namespace yara
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace yara
+{
+    /**
+     * @brief bounded blocking queue, producers wait while it is full which
+     * gives backpressure to whoever feeds it
+     */
+    template <typename T> class Queue
+    {
+    public:
+        explicit Queue(size_t p_capacity) : capacity_(p_capacity), closed_(false)
+        {
+        }
+        ~Queue() = default;
+
+        /* blocks while full, false once the queue is closed */
+        bool push(T &&p_item)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            not_full_.wait(
+                lock, [this]() { return closed_ || items_.size() < capacity_; });
+            if (closed_)
+                return false;
+
+            items_.push_back(std::move(p_item));
+            not_empty_.notify_one();
+            return true;
+        }
+
+        /* never blocks, false when full or closed */
+        bool try_push(T &&p_item)
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            if (closed_ || items_.size() >= capacity_)
+                return false;
+
+            items_.push_back(std::move(p_item));
+            not_empty_.notify_one();
+            return true;
+        }
+
+        /* blocks until an item arrives, empty once closed and drained */
+        std::optional<T> pop()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            not_empty_.wait(lock,
+                            [this]() { return closed_ || !items_.empty(); });
+            return take(lock);
+        }
+
+        std::optional<T> pop_for(std::chrono::milliseconds p_timeout)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            not_empty_.wait_for(lock,
+                                p_timeout,
+                                [this]() { return closed_ || !items_.empty(); });
+            return take(lock);
+        }
+
+        std::optional<T> try_pop()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            return take(lock);
+        }
+
+        void close()
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            not_empty_.notify_all();
+            not_full_.notify_all();
+        }
+
+        [[nodiscard]] size_t size() const
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            return items_.size();
+        }
+
+        [[nodiscard]] size_t capacity() const
+        {
+            return capacity_;
+        }
+
+        [[nodiscard]] bool closed() const
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            return closed_;
+        }
+
+    private:
+        const size_t capacity_;
+        bool closed_;
+        mutable std::mutex mutex_;
+        std::condition_variable not_empty_;
+        std::condition_variable not_full_;
+        std::deque<T> items_;
+
+        std::optional<T> take(std::unique_lock<std::mutex> &)
+        {
+            if (items_.empty())
+                return std::nullopt;
+
+            std::optional<T> item(std::move(items_.front()));
+            items_.pop_front();
+            not_full_.notify_one();
+            return item;
+        }
+
+        Queue(const Queue &) = delete;
+        Queue &operator=(const Queue &) = delete;
+    };
+} // namespace yara
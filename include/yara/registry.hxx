@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <yara/entitys.hxx>
+
+namespace yara
+{
+    /**
+     * @brief process wide table of compiled rules keyed by name and
+     * version, instances attaching to an entry share one copy of the
+     * rules instead of compiling or loading their own
+     */
+    class Registry
+    {
+    public:
+        static Registry &instance();
+
+        /* throws yara::exception::Registry if the version already exists */
+        void publish(const std::string &, uint64_t, yara::type::Rules);
+        /* version 0 attaches to the latest published version */
+        [[nodiscard]] yara::type::Rules attach(const std::string &,
+                                               uint64_t = 0) const;
+        /* attach, or build and publish once when nobody published it */
+        [[nodiscard]] yara::type::Rules
+        acquire(const std::string &,
+                uint64_t,
+                const std::function<yara::type::Rules()> &);
+        /* attached instances keep their rules until they load others */
+        const bool unpublish(const std::string &, uint64_t = 0);
+
+        [[nodiscard]] std::vector<yara::type::RegistryEntry> entries() const;
+        /* arena footprint of every published version */
+        [[nodiscard]] size_t bytes() const;
+
+    private:
+        using Key = std::pair<std::string, uint64_t>;
+
+        struct Entry
+        {
+            yara::type::Rules rules;
+            size_t bytes = 0;
+        };
+
+        mutable std::mutex mutex_;
+        std::map<Key, Entry> entries_;
+        std::map<Key, std::shared_future<yara::type::Rules>> pending_;
+
+        Registry() = default;
+        ~Registry();
+
+        static size_t footprint(const YR_RULES *);
+        [[nodiscard]] std::map<Key, Entry>::const_iterator
+        find_locked(const std::string &, uint64_t) const;
+
+        Registry(const Registry &) = delete;
+        Registry &operator=(const Registry &) = delete;
+    };
+} // namespace yara
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <yara/entitys.hxx>
+
+namespace yara
+{
+    /* verdict of one slot, as read back by the producer */
+    struct RingVerdict
+    {
+        uint64_t id = 0;
+        /* empty when the scan succeeded */
+        std::string error;
+        /* "namespace:identifier" of every matching rule that fit */
+        std::vector<std::string> rules;
+        uint32_t matches = 0;
+        bool truncated = false;
+    };
+
+    /**
+     * @brief POSIX shared memory ring of fixed size slots. Slot indexes
+     * move between three lock free queues living in the segment: free
+     * (owned by producers), ready (waiting for a scanner) and done
+     * (verdict written, waiting for the producer). Payloads are scanned
+     * in place, only the slot index crosses the queues
+     */
+    class Ring
+    {
+    public:
+        static constexpr uint32_t MAGIC = 0x594c5247; /* "YLRG" */
+        static constexpr uint32_t VERSION = 1;
+        static constexpr size_t VERDICT_SIZE = 1024;
+
+        /* creates the segment, replacing a stale one with the same name.
+         * The creator unlinks it when destroyed */
+        [[nodiscard]] static std::unique_ptr<Ring>
+        create(const std::string &,
+               uint32_t /* slots, rounded up to a power of two */,
+               size_t /* slot size */);
+        [[nodiscard]] static std::unique_ptr<Ring> open(const std::string &);
+        ~Ring();
+
+        [[nodiscard]] const std::string &name() const;
+        [[nodiscard]] const uint32_t slots() const;
+        [[nodiscard]] const size_t slot_size() const;
+        [[nodiscard]] uint8_t *data(uint32_t) const;
+
+        /* producer side, acquire is empty while every slot is in use */
+        [[nodiscard]] std::optional<uint32_t> acquire();
+        void publish(uint32_t, uint64_t /* id */, size_t /* size */);
+        /* copies into a free slot and publishes it, false when full */
+        [[nodiscard]] const bool submit(std::string_view, uint64_t /* id */);
+        /* next verdict, its slot goes back to the free queue */
+        [[nodiscard]] std::optional<RingVerdict> collect();
+
+        /* consumer side, the slot payload stays valid until complete.
+         * Indexes and sizes come from the producer, take drops indexes
+         * out of range and size never exceeds the slot */
+        [[nodiscard]] std::optional<uint32_t> take();
+        [[nodiscard]] const size_t size(uint32_t) const;
+        [[nodiscard]] const uint64_t id(uint32_t) const;
+        void complete(uint32_t, const yara::type::ScanResult &);
+
+    private:
+        struct Cell
+        {
+            std::atomic<uint64_t> sequence;
+            uint32_t value;
+        };
+
+        struct alignas(64) Cursor
+        {
+            std::atomic<uint64_t> position;
+        };
+
+        struct Queue
+        {
+            Cursor enqueue;
+            Cursor dequeue;
+        };
+
+        struct Header
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t slots;
+            uint32_t verdict_size;
+            uint64_t slot_size;
+            uint64_t total_size;
+            Queue queues[3];
+        };
+
+        struct Slot
+        {
+            uint64_t id;
+            uint64_t size;
+            uint32_t failed;
+            uint32_t matches;
+            uint32_t truncated;
+            uint32_t length;
+            char verdict[VERDICT_SIZE];
+        };
+
+        static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                      "the ring needs lock free 64 bit atomics");
+
+        enum : size_t
+        {
+            FREE = 0,
+            READY = 1,
+            DONE = 2
+        };
+
+        const std::string name_;
+        const bool owner_;
+        uint8_t *base_;
+        size_t length_;
+        Header *header_;
+        /* read once, the header stays writable by every process */
+        const uint32_t count_;
+        const size_t slot_size_;
+        Cell *cells_[3];
+        Slot *slots_;
+        uint8_t *data_;
+
+        Ring(const std::string &, bool, uint8_t *, size_t);
+
+        [[nodiscard]] static size_t layout(uint32_t, size_t, size_t *);
+        [[nodiscard]] const bool push(size_t, uint32_t);
+        [[nodiscard]] std::optional<uint32_t> pop(size_t);
+
+        Ring(const Ring &) = delete;
+        Ring &operator=(const Ring &) = delete;
+    };
+} // namespace yara
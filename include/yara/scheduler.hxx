@@ -0,0 +1,155 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <yara/entitys.hxx>
+#include <yara/latency.hxx>
+#include <yara/queue.hxx>
+
+namespace yara
+{
+    class Yara;
+
+    struct LaneOptions
+    {
+        /* threads dedicated to the lane */
+        size_t workers = 1;
+        /* queued jobs before submit starts rejecting */
+        size_t capacity = 64;
+    };
+
+    struct SchedulerOptions
+    {
+        LaneOptions fast{2, 256};
+        LaneOptions bulk{1, 16};
+        LaneOptions priority{1, 64};
+        /* Auto sends inputs up to this size to the fast lane */
+        size_t fast_limit = 1 << 20;
+        /* priority pressure from which idle fast workers take priority
+         * jobs too, above 1 never */
+        double steal_pressure = 0.25;
+        /* finished jobs kept until polled, workers wait when it is full */
+        size_t results = 1024;
+    };
+
+    struct JobResult
+    {
+        uint64_t id = 0;
+        yara::type::Lane lane = yara::type::Lane::Fast;
+        yara::type::ScanResult result;
+        uint64_t wait_ns = 0;
+        uint64_t service_ns = 0;
+    };
+
+    struct LaneStats
+    {
+        size_t queued = 0;
+        size_t capacity = 0;
+        size_t workers = 0;
+        uint64_t submitted = 0;
+        uint64_t rejected = 0;
+        uint64_t completed = 0;
+        /* time spent queued, then time spent scanning */
+        LatencyReport wait;
+        LatencyReport service;
+    };
+
+    /**
+     * @brief runs scans of one Yara object on lanes with their own bounded
+     * queue and workers, so large inputs can not starve small ones. Fast
+     * workers take priority jobs first while the priority lane is at or
+     * above steal_pressure
+     */
+    class Scheduler
+    {
+    public:
+        Scheduler(const yara::Yara &, const SchedulerOptions & = {});
+        ~Scheduler();
+
+        /* job id, 0 when the lane is full or the scheduler is closed */
+        [[nodiscard]] uint64_t
+        submit_bytes(std::string /* data */,
+                     const std::string & /* name */,
+                     yara::type::Lane,
+                     yara::type::Flags,
+                     const yara::type::ScanOptions & = {});
+        [[nodiscard]] uint64_t
+        submit_file(const std::string &,
+                    yara::type::Lane,
+                    yara::type::Flags,
+                    const yara::type::ScanOptions & = {});
+
+        /* finished jobs, waits up to timeout for the first one */
+        [[nodiscard]] std::vector<JobResult>
+        poll(size_t /* max, 0 is all */,
+             std::chrono::milliseconds = std::chrono::milliseconds(0));
+        /* submitted jobs whose result was not polled yet */
+        [[nodiscard]] size_t outstanding() const;
+
+        /* queued over capacity, 1 means submit rejects */
+        [[nodiscard]] double pressure(yara::type::Lane) const;
+        [[nodiscard]] LaneStats stats(yara::type::Lane) const;
+        /* stop accepting jobs, queued ones still run */
+        void close();
+
+    private:
+        struct Job
+        {
+            uint64_t id = 0;
+            bool file = false;
+            std::string path;
+            std::string data;
+            yara::type::Flags flags{};
+            yara::type::ScanOptions options;
+            std::chrono::steady_clock::time_point queued;
+        };
+
+        struct Lane
+        {
+            explicit Lane(size_t p_capacity) : jobs(p_capacity)
+            {
+            }
+
+            yara::Queue<Job> jobs;
+            size_t workers = 0;
+            std::atomic<uint64_t> submitted{0};
+            std::atomic<uint64_t> rejected{0};
+            std::atomic<uint64_t> completed{0};
+            yara::Latency wait;
+            yara::Latency service;
+        };
+
+        const yara::Yara &yara_;
+        const size_t fast_limit_;
+        const double steal_pressure_;
+        /* fast workers wait here for a job on their lane or priority
+         * pressure, pushes to either lane signal it */
+        std::mutex wake_mutex_;
+        std::condition_variable wake_;
+        std::array<std::unique_ptr<Lane>, 3> lanes_;
+        yara::Queue<JobResult> results_;
+        std::atomic<uint64_t> next_id_;
+        std::atomic<size_t> outstanding_;
+        std::atomic<bool> stopping_;
+        std::vector<std::thread> workers_;
+
+        [[nodiscard]] uint64_t submit(Job &&, yara::type::Lane, size_t);
+        [[nodiscard]] Lane &lane(yara::type::Lane) const;
+        void work(yara::type::Lane);
+        [[nodiscard]] const bool backed_up() const;
+        void wake(bool /* all */);
+        void run(Job &&, yara::type::Lane);
+
+        Scheduler(const Scheduler &) = delete;
+        Scheduler &operator=(const Scheduler &) = delete;
+    };
+} // namespace yara
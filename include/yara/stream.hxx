@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <yara.h>
+
+namespace yara
+{
+    namespace stream
+    {
+        /* default buffer used by descriptor streams (1 MiB) */
+        inline constexpr size_t BUFFER_SIZE = 1 << 20;
+
+        /**
+         * @brief YR_STREAM reading straight from memory owned by the
+         * caller, no intermediate copies
+         */
+        class Memory
+        {
+        public:
+            explicit Memory(std::string_view = {});
+            ~Memory() = default;
+
+            [[nodiscard]] YR_STREAM &get();
+
+        private:
+            std::string_view buffer_;
+            size_t offset_;
+            YR_STREAM stream_;
+
+            static size_t read(void *, size_t, size_t, void *);
+        };
+
+        /**
+         * @brief buffered YR_STREAM over a file descriptor, the
+         * descriptor is not closed
+         */
+        class Descriptor
+        {
+        public:
+            explicit Descriptor(int, size_t = BUFFER_SIZE);
+            ~Descriptor() = default;
+
+            [[nodiscard]] YR_STREAM &get();
+            [[nodiscard]] const int flush();
+
+        private:
+            int fd_;
+            std::vector<uint8_t> buffer_;
+            size_t begin_;
+            size_t end_;
+            bool failed_;
+            YR_STREAM stream_;
+
+            static size_t read(void *, size_t, size_t, void *);
+            static size_t write(const void *, size_t, size_t, void *);
+        };
+
+        /**
+         * @brief read only mapping of a compiled rules file exposed as
+         * YR_STREAM
+         */
+        class Mapped
+        {
+        public:
+            explicit Mapped(const std::string &);
+            ~Mapped();
+
+            [[nodiscard]] const int error() const;
+            [[nodiscard]] YR_STREAM &get();
+            /* the whole mapping, empty when error() is set */
+            [[nodiscard]] std::string_view view() const;
+
+        private:
+            void *data_;
+            size_t size_;
+            int error_;
+            Memory memory_;
+
+            Mapped(const Mapped &) = delete;
+            Mapped &operator=(const Mapped &) = delete;
+        };
+    } // namespace stream
+} // namespace yara
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <yara/entitys.hxx>
+
+namespace yara
+{
+    /**
+     * @brief watches a rules folder with inotify, recursively and with the
+     * layout of set_rules_folder. Bursts of changes are debounced, and
+     * reload only runs when the content of the '.yar' files changed
+     */
+    class Watcher
+    {
+    public:
+        /* false when the reload could not start, it is retried later */
+        using Reload =
+            std::function<bool(std::vector<yara::type::RuleSource> &&)>;
+        using Report = std::function<void(yara::type::CompileEvent &&)>;
+
+        Watcher(const std::string &,
+                std::chrono::milliseconds /* debounce */,
+                Reload,
+                Report);
+        ~Watcher();
+
+        [[nodiscard]] const std::string &path() const;
+
+    private:
+        const std::string path_;
+        const std::chrono::milliseconds debounce_;
+        const Reload reload_;
+        const Report report_;
+
+        int inotify_fd_;
+        int stop_fd_;
+        std::unordered_map<int, std::string> watches_;
+        /* content hash of every source the loaded rules came from */
+        std::map<std::string, uint64_t> hashes_;
+        std::thread thread_;
+
+        void run();
+        /* true when something relevant to the rules changed */
+        [[nodiscard]] const bool drain();
+        [[nodiscard]] const bool rescan();
+        void watch_tree(const std::string &);
+        [[nodiscard]] std::map<std::string, uint64_t>
+        hash(const std::vector<yara::type::RuleSource> &) const;
+
+        Watcher(const Watcher &) = delete;
+        Watcher &operator=(const Watcher &) = delete;
+    };
+} // namespace yara
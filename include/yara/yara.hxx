@@ -1,18 +1,33 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
+#include <deque>
+#include <yara/blocks.hxx>
+#include <yara/digest.hxx>
 #include <yara/entitys.hxx>
 #include <yara/extend/yara.hxx>
+#include <yara/index.hxx>
+#include <yara/latency.hxx>
+#include <yara/linter.hxx>
+#include <yara/modules.hxx>
 #include <filesystem>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <shared_mutex>
 #include <stack>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 #include <yara.h>
 
 namespace yara
 {
     class Yara; // Forward declaration yara plugin
+    class Registry;
+    class Watcher;
 
     class Yara
     {
@@ -21,6 +36,7 @@ namespace yara
         ~Yara();
 
         friend class yara::extend::Yara;
+        friend class yara::Registry;
 
         /**
          * @brief function for scan, but, you pass flag and callback for
@@ -28,19 +44,94 @@ namespace yara
          * @param YR_CALLBACK_FUNC callback for scan yara
          * @param void* user_data, pass for example Yr::Structs::Data
          * @param int flags used for scan
+         * @param ScanOptions per scan settings, external variables given
+         * here only apply to this scan
          */
         void scan_bytes(const std::string &,
                         YR_CALLBACK_FUNC,
                         void *,
-                        yara::type::Flags) const;
+                        yara::type::Flags,
+                        const yara::type::ScanOptions & = {}) const;
 
         void scan_file(const std::string &,
                        YR_CALLBACK_FUNC,
                        void *,
-                       yara::type::Flags) const;
+                       yara::type::Flags,
+                       const yara::type::ScanOptions & = {}) const;
+
+        void scan_mem(const uint8_t *,
+                      size_t,
+                      YR_CALLBACK_FUNC,
+                      void *,
+                      yara::type::Flags,
+                      const yara::type::ScanOptions & = {}) const;
+
+        /* buffers scanned as one input at increasing offsets, never joined.
+         * Strings spanning two buffers do not match */
+        void scan_chunks(const std::vector<std::string_view> &,
+                         YR_CALLBACK_FUNC,
+                         void *,
+                         yara::type::Flags,
+                         const yara::type::ScanOptions & = {}) const;
+        /* blocks pulled from a native source while the scan runs */
+        void scan_source(const yaral_block_source &,
+                         YR_CALLBACK_FUNC,
+                         void *,
+                         yara::type::Flags,
+                         const yara::type::ScanOptions & = {}) const;
+
+        /**
+         * @brief scan a list of files on a pool of threads, reads run ahead
+         * of the scanners through io_uring (pread pool as fallback)
+         * @return one result per path, in the same order
+         */
+        [[nodiscard]] std::vector<yara::type::ScanResult> scan_files(
+            const std::vector<std::string> &,
+            yara::type::Flags,
+            const yara::type::ScanOptions & = {},
+            const yara::type::BulkOptions & = {}) const;
+
+        /* YR_CALLBACK_FUNC filling the yara::type::ScanResult in user_data */
+        /**
+         * @brief scan every member of a zip, gzip or tar container,
+         * nested ones included, decompressing in memory. Data that is not
+         * a container is scanned as a single result
+         */
+        [[nodiscard]] std::vector<yara::type::ScanResult> scan_archive(
+            const std::string &,
+            yara::type::Flags,
+            const yara::type::ScanOptions & = {},
+            const yara::type::ArchiveLimits & = {}) const;
+        [[nodiscard]] std::vector<yara::type::ScanResult> scan_archive_bytes(
+            std::string_view,
+            const std::string & /* name */,
+            yara::type::Flags,
+            const yara::type::ScanOptions & = {},
+            const yara::type::ArchiveLimits & = {}) const;
+
+        static int collect(YR_SCAN_CONTEXT *, int, void *, void *);
+        /* early exit report of the last scan run by the calling thread */
+        [[nodiscard]] static const yara::type::ExitReport &last_exit();
+        /* digests of the last scan run by the calling thread */
+        [[nodiscard]] static const yara::DigestMap &last_digests();
 
         void rule_disable(YR_RULE &);
         void rule_enable(YR_RULE &);
+        /* bulk toggles through the rule index, they return the number of
+         * rules selected and are replayed on every reload. Toggles wait
+         * for running scans, inside rules_foreach or a scan callback they
+         * apply once it returns */
+        [[nodiscard]] const size_t rules_disable(yara::type::RuleKey,
+                                                 const std::string &);
+        [[nodiscard]] const size_t rules_enable(yara::type::RuleKey,
+                                                const std::string &);
+        /* "namespace:identifier" of the rules found, in table order */
+        [[nodiscard]] std::vector<std::string>
+        rules_find(yara::type::RuleKey, const std::string &) const;
+        [[nodiscard]] std::vector<yara::type::RuleToggle>
+        rules_toggled() const;
+        /* forget the toggles, the loaded rules keep their state */
+        void rules_toggled_clear();
         void rules_foreach(const std::function<void(const YR_RULE &)> &);
 
         void metas_foreach(YR_RULE *,
@@ -62,6 +153,13 @@ namespace yara
         void unload_rules();
         [[nodiscard]] const int load_rules_stream(YR_STREAM &);
         [[nodiscard]] const int save_rules_stream(YR_STREAM &);
+
+        /* load compiled rules straight from memory, no copies */
+        [[nodiscard]] const int load_rules_bytes(std::string_view);
+        [[nodiscard]] const int load_rules_fd(int);
+        [[nodiscard]] const int save_rules_fd(int);
+        /* load compiled rules file through a read only mapping */
+        [[nodiscard]] const int load_rules_mmap(const std::string &);
         [[nodiscard]] const int load_compiler();
         void unload_compiler();
 
@@ -70,6 +168,38 @@ namespace yara
         /* load rules if extension file '.yar'*/
         void set_rules_folder(const std::string & /* path */) const;
 
+        /* '.yar' files under path, namespaced like set_rules_folder */
+        [[nodiscard]] static std::vector<yara::type::RuleSource>
+        collect_rules_folder(const std::string & /* path */);
+
+        /**
+         * @brief compile sources with a fresh compiler on a background
+         * thread, the result replaces the loaded rules in a single step
+         * while the current ones keep serving scans
+         */
+        void compile_async(std::vector<yara::type::RuleSource>);
+        [[nodiscard]] std::vector<yara::type::CompileEvent> compile_poll();
+        [[nodiscard]] const bool compiling() const;
+
+        /**
+         * @brief reload a rules folder when its '.yar' files change, the
+         * rules loaded at this point are the baseline. Reloads report
+         * through compile_poll like compile_async
+         */
+        void watch_rules(const std::string &,
+                         std::chrono::milliseconds = std::chrono::milliseconds(
+                             500));
+        void unwatch_rules();
+        [[nodiscard]] const bool watching() const;
+
+        /**
+         * @brief compile sources with a throwaway compiler and report the
+         * cost of every rule, the loaded rules are left untouched
+         */
+        [[nodiscard]] yara::LintReport
+        lint(const std::vector<yara::type::RuleSource> &,
+             const yara::LintOptions & = {}) const;
+
         [[nodiscard]] const int set_rule_buff(const std::string &,
                                               const std::string &) const;
         [[nodiscard]] const int set_rule_file(const std::string &,
@@ -86,6 +216,26 @@ namespace yara
                                    void *,
                                    std::function<void(void *)> = {});
 
+        /* module import policy applied natively on every scan */
+        [[nodiscard]] yara::Modules &modules();
+
+        /**
+         * @brief process wide rules registry, instances sharing rules hold
+         * one copy and can not enable or disable rules
+         * @param version 0 means the latest published version on attach
+         */
+        void publish_rules(const std::string &, uint64_t) const;
+        void attach_rules(const std::string &, uint64_t = 0) const;
+        /* attach if published, otherwise compile the sources once and
+         * publish them. Only the caller that publishes compiles */
+        void share_rules(const std::string &,
+                         uint64_t,
+                         const std::vector<yara::type::RuleSource> &) const;
+
+        /* scan throughput and tail latency since the last reset */
+        [[nodiscard]] yara::LatencyReport scan_stats() const;
+        void scan_stats_reset();
+
     private:
         static std::mutex lifecycle_mutex_;
         static size_t lifecycle_refs_;
@@ -93,19 +243,88 @@ namespace yara
         mutable std::mutex compiler_mutex_;
         mutable std::shared_mutex rules_mutex_;
 
-        template <typename Callback>
-        void execute_safely(Callback &&cb) const
-        {
-            const std::shared_lock<std::shared_mutex> lock(rules_mutex_);
-            cb();
-        }
-
         YR_COMPILER *yara_compiler_;
-        mutable YR_RULES *yara_rules_;
+        mutable yara::type::Rules yara_rules_;
+        /* lookup of yara_rules_, swapped together with it */
+        mutable std::shared_ptr<const yara::RuleIndex> rules_index_;
+        /* toggles in the order they were made, one per key and name.
+         * Taken after rules_mutex_, which toggles hold exclusively */
+        mutable std::mutex toggles_mutex_;
+        std::vector<yara::type::RuleToggle> toggles_;
+        /* toggles made while their thread held rules_mutex_ shared */
+        mutable std::vector<yara::type::RuleToggle> pending_;
         void *compiler_callback_user_data_;
         std::function<void(void *)> compiler_callback_cleanup_;
+        /* rules come from or were published to the registry */
+        mutable std::atomic<bool> rules_shared_;
+
+        /* scanners bound to yara_rules_, reused between scans */
+        mutable std::mutex scanners_mutex_;
+        mutable std::stack<YR_SCANNER *> scanners_;
+
+        yara::Modules modules_;
+        mutable yara::Latency latency_;
+
+        /* externals replayed on compilers built by compile_async */
+        mutable yara::type::Externals compiler_externals_;
+
+        std::mutex compile_mutex_;
+        std::thread compile_thread_;
+        std::atomic<bool> compiling_;
+        mutable std::mutex watcher_mutex_;
+        std::unique_ptr<yara::Watcher> watcher_;
+        std::mutex events_mutex_;
+        std::deque<yara::type::CompileEvent> events_;
 
         void clear_compiler_callback_locked();
         void compiler_rules() const;
+        [[nodiscard]] const int load_rules_from(YR_STREAM &);
+        void install_rules(YR_RULES *) const;
+        void install_rules(yara::type::Rules, bool) const;
+        void check_writable() const;
+        class RulesLock;
+
+        [[nodiscard]] const size_t toggle(yara::type::RuleToggle &&);
+        void apply_pending() const;
+        static const size_t apply(const yara::RuleIndex &,
+                                  const yara::type::RuleToggle &);
+
+        static void lifecycle_acquire();
+        static void lifecycle_release();
+        [[nodiscard]] static yara::type::Rules own_rules(YR_RULES *);
+
+        /* folders replaced by the '.yar' files under them */
+        [[nodiscard]] static std::vector<yara::type::RuleSource>
+        expand_sources(const std::vector<yara::type::RuleSource> &);
+        /* sources come expanded, events count them one by one. setup
+         * sees the compiler before the first source is added */
+        [[nodiscard]] YR_RULES *build_rules(
+            const std::vector<yara::type::RuleSource> &,
+            const std::function<void(yara::type::CompileEvent &&)> &,
+            const std::function<void(YR_COMPILER *)> & = {}) const;
+        /* build and install, progress and errors go to compile_poll */
+        void compile_install(const std::vector<yara::type::RuleSource> &);
+        /* watcher reloads, false while another compile runs */
+        [[nodiscard]] const bool
+        reload_rules(std::vector<yara::type::RuleSource> &&);
+        void push_event(yara::type::CompileEvent &&);
+
+        [[nodiscard]] YR_SCANNER *acquire_scanner() const;
+        void release_scanner(YR_SCANNER *) const;
+        void clear_scanners() const;
+        [[nodiscard]] const int scan_with(
+            const yara::type::ScanOptions &,
+            YR_CALLBACK_FUNC,
+            void *,
+            yara::type::Flags,
+            yara::type::ScanResult *,
+            const std::function<int(YR_SCANNER *)> &) const;
+        /* runs one scan, emits its result when an emitter is set and
+         * throws when the named libyara call failed */
+        void run_scan(
+            const char *,
+            const std::string &,
+            const yara::type::ScanOptions &,
+            const std::function<int(yara::type::ScanResult *)> &) const;
     };
 } // namespace security
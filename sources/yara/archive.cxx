@@ -0,0 +1,535 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <fmt/core.h>
+#include <yara/archive.hxx>
+
+#ifdef YARAL_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace yara
+{
+    namespace
+    {
+        constexpr size_t TAR_BLOCK = 512;
+        /* small members compress well without being bombs */
+        constexpr size_t RATIO_FLOOR = 1 << 20;
+
+        uint16_t read16(const uint8_t *p_data)
+        {
+            return static_cast<uint16_t>(p_data[0] | (p_data[1] << 8));
+        }
+
+        uint32_t read32(const uint8_t *p_data)
+        {
+            return static_cast<uint32_t>(read16(p_data)) |
+                   (static_cast<uint32_t>(read16(p_data + 2)) << 16);
+        }
+
+        /* tar numeric field, octal or GNU base-256 for big values */
+        uint64_t tar_number(const uint8_t *p_field, size_t p_size)
+        {
+            uint64_t value = 0;
+            if (p_field[0] & 0x80)
+            {
+                for (size_t i = 1; i < p_size; ++i)
+                {
+                    value = (value << 8) | p_field[i];
+                }
+                return value;
+            }
+
+            for (size_t i = 0; i < p_size; ++i)
+            {
+                if (p_field[i] >= '0' && p_field[i] <= '7')
+                    value = (value << 3) | (p_field[i] - '0');
+                else if (p_field[i] != ' ' || value != 0)
+                    break;
+            }
+            return value;
+        }
+
+        bool tar_checksum(const uint8_t *p_header)
+        {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < TAR_BLOCK; ++i)
+            {
+                // The checksum field counts as spaces
+                sum += (i >= 148 && i < 156) ? ' ' : p_header[i];
+            }
+            return sum == tar_number(p_header + 148, 8);
+        }
+
+        std::string tar_field(const uint8_t *p_field, size_t p_size)
+        {
+            const auto *begin = reinterpret_cast<const char *>(p_field);
+            return std::string(begin, strnlen(begin, p_size));
+        }
+
+        /* name of a gzip member without a stored name: a.gz -> a */
+        std::string gzip_name(const std::string &p_parent)
+        {
+            const size_t slash = p_parent.find_last_of("/!");
+            std::string name = slash == std::string::npos
+                                   ? p_parent
+                                   : p_parent.substr(slash + 1);
+
+            const auto ends_with = [&name](std::string_view p_suffix)
+            {
+                return name.size() > p_suffix.size() &&
+                       name.compare(name.size() - p_suffix.size(),
+                                    p_suffix.size(),
+                                    p_suffix) == 0;
+            };
+            if (ends_with(".tgz"))
+                name.replace(name.size() - 4, 4, ".tar");
+            else if (ends_with(".gz"))
+                name.resize(name.size() - 3);
+            else
+                name = "data";
+            return name;
+        }
+    } // namespace
+
+    Archive::Archive(const yara::type::ArchiveLimits &p_limits,
+                     yara::Buffers &p_buffers)
+        : limits_(p_limits), buffers_(p_buffers), members_(0), expanded_(0),
+          stopped_(false)
+    {
+    }
+
+    Archive::Format Archive::detect(const uint8_t *p_data, size_t p_size)
+    {
+        if (p_size >= 3 && p_data[0] == 0x1f && p_data[1] == 0x8b &&
+            p_data[2] == 8)
+            return Format::Gzip;
+
+        if (p_size >= 4 && p_data[0] == 'P' && p_data[1] == 'K' &&
+            ((p_data[2] == 3 && p_data[3] == 4) ||
+             (p_data[2] == 5 && p_data[3] == 6)))
+            return Format::Zip;
+
+        if (p_size >= TAR_BLOCK && std::memcmp(p_data + 257, "ustar", 5) == 0)
+            return Format::Tar;
+
+        return Format::None;
+    }
+
+    const bool Archive::walk(const std::string &p_name,
+                             const uint8_t *p_data,
+                             size_t p_size,
+                             const Visit &p_visit)
+    {
+        members_ = 0;
+        expanded_ = 0;
+        stopped_ = false;
+
+        const Format format = Archive::detect(p_data, p_size);
+        if (format == Format::None || limits_.depth == 0)
+            return false;
+
+        return Archive::walk_node(p_name, p_data, p_size, format, 1, p_visit);
+    }
+
+    const bool Archive::walk_node(const std::string &p_name,
+                                  const uint8_t *p_data,
+                                  size_t p_size,
+                                  Format p_format,
+                                  size_t p_depth,
+                                  const Visit &p_visit)
+    {
+        switch (p_format)
+        {
+        case Format::Zip:
+            return Archive::walk_zip(p_name, p_data, p_size, p_depth, p_visit);
+        case Format::Tar:
+            return Archive::walk_tar(p_name, p_data, p_size, p_depth, p_visit);
+        case Format::Gzip:
+            return Archive::walk_gzip(
+                p_name, p_data, p_size, p_depth, p_visit);
+        default:
+            return false;
+        }
+    }
+
+    const bool Archive::admit(const std::string &p_path, const Visit &p_visit)
+    {
+        if (stopped_)
+            return false;
+
+        if (members_ >= limits_.members)
+        {
+            stopped_ = true;
+            p_visit(p_path,
+                    nullptr,
+                    0,
+                    fmt::format("member limit of {} reached", limits_.members));
+            return false;
+        }
+        ++members_;
+        return true;
+    }
+
+    void Archive::member(const std::string &p_path,
+                         const uint8_t *p_data,
+                         size_t p_size,
+                         size_t p_depth,
+                         const Visit &p_visit)
+    {
+        const Format format = Archive::detect(p_data, p_size);
+        if (format != Format::None && p_depth < limits_.depth &&
+            Archive::walk_node(
+                p_path, p_data, p_size, format, p_depth + 1, p_visit))
+            return;
+
+        // Too deep or not parseable, scan it as it is
+        p_visit(p_path, p_data, p_size, {});
+    }
+
+    void Archive::decoded(const std::string &p_path,
+                          yara::Buffer &p_buffer,
+                          const std::string &p_error,
+                          size_t p_depth,
+                          const Visit &p_visit)
+    {
+        if (p_error.empty())
+            Archive::member(
+                p_path, p_buffer.data.get(), p_buffer.size, p_depth, p_visit);
+        else
+            p_visit(p_path, p_buffer.data.get(), p_buffer.size, p_error);
+
+        buffers_.release(std::move(p_buffer));
+    }
+
+    const bool Archive::walk_zip(const std::string &p_name,
+                                 const uint8_t *p_data,
+                                 size_t p_size,
+                                 size_t p_depth,
+                                 const Visit &p_visit)
+    {
+        constexpr size_t EOCD = 22;
+        if (p_size < EOCD)
+            return false;
+
+        // End of central directory, followed by at most a 64k comment
+        size_t eocd = std::string::npos;
+        const size_t lowest =
+            p_size > EOCD + 0xFFFF ? p_size - EOCD - 0xFFFF : 0;
+        for (size_t at = p_size - EOCD + 1; at-- > lowest;)
+        {
+            if (read32(p_data + at) == 0x06054b50)
+            {
+                eocd = at;
+                break;
+            }
+        }
+        if (eocd == std::string::npos)
+            return false;
+
+        const uint16_t entries = read16(p_data + eocd + 10);
+        const uint32_t directory = read32(p_data + eocd + 16);
+        if (entries == 0xFFFF || directory == 0xFFFFFFFF)
+        {
+            p_visit(p_name, nullptr, 0, "zip64 archives are not supported");
+            return true;
+        }
+        if (directory > eocd)
+            return false;
+
+        size_t at = directory;
+        for (uint16_t i = 0; i < entries && !stopped_; ++i)
+        {
+            if (at + 46 > eocd || read32(p_data + at) != 0x02014b50)
+            {
+                p_visit(p_name, nullptr, 0, "corrupt zip central directory");
+                break;
+            }
+
+            const uint16_t flags = read16(p_data + at + 8);
+            const uint16_t method = read16(p_data + at + 10);
+            const uint32_t compressed = read32(p_data + at + 20);
+            const size_t name_size = read16(p_data + at + 28);
+            const size_t local = read32(p_data + at + 42);
+            const std::string entry(
+                reinterpret_cast<const char *>(p_data + at + 46),
+                std::min(name_size, eocd - at - 46));
+            at += 46 + name_size + read16(p_data + at + 30) +
+                  read16(p_data + at + 32);
+
+            if (entry.empty() || entry.back() == '/')
+                continue;
+
+            const std::string path = p_name + "!" + entry;
+            if (!Archive::admit(path, p_visit))
+                break;
+
+            if (local + 30 > p_size || read32(p_data + local) != 0x04034b50)
+            {
+                p_visit(path, nullptr, 0, "corrupt zip local header");
+                continue;
+            }
+            const size_t offset = local + 30 + read16(p_data + local + 26) +
+                                  read16(p_data + local + 28);
+            if (offset > p_size || compressed > p_size - offset)
+            {
+                p_visit(path, nullptr, 0, "truncated zip member");
+                continue;
+            }
+            if (flags & 1)
+            {
+                p_visit(path, nullptr, 0, "encrypted zip member");
+                continue;
+            }
+
+            if (method == 0)
+            {
+                Archive::member(
+                    path, p_data + offset, compressed, p_depth, p_visit);
+            }
+            else if (method == 8)
+            {
+                yara::Buffer buffer;
+                std::string stored_name, error;
+                if (Archive::inflate(p_data + offset,
+                                     compressed,
+                                     false,
+                                     buffer,
+                                     stored_name,
+                                     error))
+                    Archive::decoded(path, buffer, error, p_depth, p_visit);
+                else
+                    p_visit(path, nullptr, 0, error);
+            }
+            else
+            {
+                p_visit(path,
+                        nullptr,
+                        0,
+                        fmt::format("unsupported zip method {}", method));
+            }
+        }
+        return true;
+    }
+
+    const bool Archive::walk_tar(const std::string &p_name,
+                                 const uint8_t *p_data,
+                                 size_t p_size,
+                                 size_t p_depth,
+                                 const Visit &p_visit)
+    {
+        size_t at = 0;
+        std::string long_name;
+        while (at + TAR_BLOCK <= p_size && !stopped_)
+        {
+            const uint8_t *header = p_data + at;
+            if (std::all_of(header,
+                            header + TAR_BLOCK,
+                            [](uint8_t p_byte) { return p_byte == 0; }))
+                break;
+
+            if (!tar_checksum(header))
+            {
+                if (at == 0)
+                    return false;
+                p_visit(p_name, nullptr, 0, "corrupt tar header");
+                break;
+            }
+
+            const uint64_t size = tar_number(header + 124, 12);
+            const char type = static_cast<char>(header[156]);
+            at += TAR_BLOCK;
+
+            std::string entry = std::move(long_name);
+            long_name.clear();
+            if (entry.empty())
+            {
+                const std::string prefix = tar_field(header + 345, 155);
+                entry = tar_field(header, 100);
+                if (!prefix.empty())
+                    entry = prefix + "/" + entry;
+            }
+            const std::string path = p_name + "!" + entry;
+
+            if (size > p_size - at)
+            {
+                p_visit(path, nullptr, 0, "truncated tar member");
+                break;
+            }
+
+            if (type == 'L')
+            {
+                // GNU long name for the next header
+                long_name = tar_field(p_data + at, size);
+            }
+            else if (type == '0' || type == '\0' || type == '7')
+            {
+                if (!Archive::admit(path, p_visit))
+                    break;
+                Archive::member(path, p_data + at, size, p_depth, p_visit);
+            }
+
+            const size_t padded =
+                (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+            at += std::min<size_t>(padded, p_size - at);
+        }
+        return true;
+    }
+
+    const bool Archive::walk_gzip(const std::string &p_name,
+                                  const uint8_t *p_data,
+                                  size_t p_size,
+                                  size_t p_depth,
+                                  const Visit &p_visit)
+    {
+        if (!Archive::admit(p_name, p_visit))
+            return true;
+
+        yara::Buffer buffer;
+        std::string entry, error;
+        const bool inflated =
+            Archive::inflate(p_data, p_size, true, buffer, entry, error);
+
+        const std::string path =
+            p_name + "!" + (entry.empty() ? gzip_name(p_name) : entry);
+        if (inflated)
+            Archive::decoded(path, buffer, error, p_depth, p_visit);
+        else
+            p_visit(path, nullptr, 0, error);
+        return true;
+    }
+
+    const bool Archive::inflate(const uint8_t *p_data,
+                                size_t p_size,
+                                bool p_gzip,
+                                yara::Buffer &p_out,
+                                std::string &p_name,
+                                std::string &p_error)
+    {
+#ifdef YARAL_HAVE_ZLIB
+        // The output may not grow past any of the limits
+        size_t limit = std::min(limits_.member_size,
+                                limits_.expanded - std::min(expanded_,
+                                                            limits_.expanded));
+        if (limits_.ratio != 0 &&
+            std::max<size_t>(p_size, 1) <= limit / limits_.ratio)
+            limit = std::min(limit,
+                             std::max(p_size * limits_.ratio, RATIO_FLOOR));
+
+        z_stream stream{};
+        if (inflateInit2(&stream, p_gzip ? 15 + 16 : -MAX_WBITS) != Z_OK)
+        {
+            p_error = "inflateInit2() failed";
+            return false;
+        }
+
+        gz_header header{};
+        char name[256] = {0};
+        if (p_gzip)
+        {
+            header.name = reinterpret_cast<Bytef *>(name);
+            header.name_max = sizeof(name) - 1;
+            inflateGetHeader(&stream, &header);
+        }
+
+        p_out = buffers_.acquire(
+            std::min(limit, std::max<size_t>(p_size * 4, 64 << 10)));
+        p_out.size = 0;
+
+        size_t consumed = 0;
+        bool limited = false;
+        for (;;)
+        {
+            // Pooled buffers may be bigger than the limit
+            if (p_out.size >= std::min(p_out.capacity, limit))
+            {
+                if (p_out.size >= limit)
+                {
+                    limited = true;
+                    break;
+                }
+                yara::Buffer grown =
+                    buffers_.acquire(std::min(limit, p_out.capacity * 2));
+                std::memcpy(grown.data.get(), p_out.data.get(), p_out.size);
+                grown.size = p_out.size;
+                buffers_.release(std::move(p_out));
+                p_out = std::move(grown);
+            }
+
+            if (stream.avail_in == 0 && consumed < p_size)
+            {
+                const size_t chunk =
+                    std::min<size_t>(p_size - consumed, UINT_MAX);
+                stream.next_in = const_cast<Bytef *>(p_data + consumed);
+                stream.avail_in = static_cast<uInt>(chunk);
+                consumed += chunk;
+            }
+
+            const size_t room = std::min<size_t>(
+                std::min(p_out.capacity, limit) - p_out.size, UINT_MAX);
+            stream.next_out = p_out.data.get() + p_out.size;
+            stream.avail_out = static_cast<uInt>(room);
+
+            const int result = ::inflate(&stream, Z_NO_FLUSH);
+            p_out.size += room - stream.avail_out;
+
+            if (result == Z_STREAM_END)
+            {
+                // Concatenated gzip members decode as one stream
+                const size_t left = stream.avail_in + (p_size - consumed);
+                if (!p_gzip || left < 3 || stream.next_in[0] != 0x1f ||
+                    stream.next_in[1] != 0x8b)
+                    break;
+                inflateReset(&stream);
+                continue;
+            }
+            if (result == Z_BUF_ERROR && stream.avail_in == 0 &&
+                consumed == p_size)
+            {
+                p_error = "truncated deflate stream";
+                break;
+            }
+            if (result != Z_OK && result != Z_BUF_ERROR)
+            {
+                p_error = stream.msg ? stream.msg : "corrupt deflate stream";
+                break;
+            }
+        }
+        inflateEnd(&stream);
+
+        if (p_gzip && header.done == 1)
+            p_name = name;
+
+        if (limited)
+        {
+            if (p_out.size >= limits_.member_size)
+                p_error = fmt::format("member size limit of {} bytes reached",
+                                      limits_.member_size);
+            else if (expanded_ + p_out.size >= limits_.expanded)
+            {
+                // Nothing else can be expanded either
+                stopped_ = true;
+                p_error = fmt::format("expanded limit of {} bytes reached",
+                                      limits_.expanded);
+            }
+            else
+                p_error = fmt::format("compression ratio above {}",
+                                      limits_.ratio);
+
+            buffers_.release(std::move(p_out));
+            return false;
+        }
+
+        expanded_ += p_out.size;
+        return true;
+#else
+        (void)p_data;
+        (void)p_size;
+        (void)p_gzip;
+        (void)p_out;
+        (void)p_name;
+        p_error = "deflate support not built, zlib was not found";
+        return false;
+#endif
+    }
+} // namespace yara
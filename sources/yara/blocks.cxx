@@ -0,0 +1,139 @@
+#include <yara/blocks.hxx>
+
+namespace yara
+{
+    namespace blocks
+    {
+        namespace
+        {
+            /* blocks keep their data pointer in context */
+            const uint8_t *fetch(YR_MEMORY_BLOCK *p_block)
+            {
+                return static_cast<const uint8_t *>(p_block->context);
+            }
+        } // namespace
+
+        Chunks::Chunks(const std::vector<std::string_view> &p_chunks)
+            : size_(0), index_(0), block_{}, iterator_{}
+        {
+            // Empty chunks add nothing to the input, libyara never sees them
+            chunks_.reserve(p_chunks.size());
+            bases_.reserve(p_chunks.size());
+            for (const std::string_view chunk : p_chunks)
+            {
+                if (chunk.empty())
+                    continue;
+                chunks_.push_back(chunk);
+                bases_.push_back(size_);
+                size_ += chunk.size();
+            }
+        }
+
+        YR_MEMORY_BLOCK_ITERATOR &Chunks::get()
+        {
+            iterator_.context = static_cast<void *>(this);
+            iterator_.first = &Chunks::first;
+            iterator_.next = &Chunks::next;
+            iterator_.file_size = &Chunks::file_size;
+            iterator_.last_error = ERROR_SUCCESS;
+            return iterator_;
+        }
+
+        const uint64_t Chunks::size() const
+        {
+            return size_;
+        }
+
+        YR_MEMORY_BLOCK *Chunks::at(size_t p_index)
+        {
+            index_ = p_index;
+            if (p_index >= chunks_.size())
+                return nullptr;
+
+            block_.size = chunks_[p_index].size();
+            block_.base = bases_[p_index];
+            block_.context = const_cast<char *>(chunks_[p_index].data());
+            block_.fetch_data = &fetch;
+            return &block_;
+        }
+
+        YR_MEMORY_BLOCK *Chunks::first(YR_MEMORY_BLOCK_ITERATOR *p_iterator)
+        {
+            return static_cast<Chunks *>(p_iterator->context)->at(0);
+        }
+
+        YR_MEMORY_BLOCK *Chunks::next(YR_MEMORY_BLOCK_ITERATOR *p_iterator)
+        {
+            auto *self = static_cast<Chunks *>(p_iterator->context);
+            return self->at(self->index_ + 1);
+        }
+
+        uint64_t Chunks::file_size(YR_MEMORY_BLOCK_ITERATOR *p_iterator)
+        {
+            return static_cast<Chunks *>(p_iterator->context)->size_;
+        }
+
+        Source::Source(const yaral_block_source &p_source)
+            : source_(p_source), started_(false), first_{}, current_{},
+              iterator_{}
+        {
+        }
+
+        YR_MEMORY_BLOCK_ITERATOR &Source::get()
+        {
+            iterator_.context = static_cast<void *>(this);
+            iterator_.first = &Source::first;
+            iterator_.next = &Source::next;
+            iterator_.file_size =
+                source_.size != nullptr ? &Source::file_size : nullptr;
+            iterator_.last_error = ERROR_SUCCESS;
+            return iterator_;
+        }
+
+        YR_MEMORY_BLOCK *Source::pull(YR_MEMORY_BLOCK &p_block)
+        {
+            yaral_block block{};
+            const int pulled = source_.next(source_.user_data, &block);
+            if (pulled < 0)
+            {
+                iterator_.last_error = ERROR_CALLBACK_ERROR;
+                return nullptr;
+            }
+            if (pulled == 0)
+                return nullptr;
+
+            p_block.size = block.size;
+            p_block.base = block.base;
+            p_block.context = const_cast<uint8_t *>(block.data);
+            p_block.fetch_data = &fetch;
+            return &p_block;
+        }
+
+        YR_MEMORY_BLOCK *Source::first(YR_MEMORY_BLOCK_ITERATOR *p_iterator)
+        {
+            auto *self = static_cast<Source *>(p_iterator->context);
+            if (!self->started_)
+            {
+                self->started_ = true;
+                if (self->pull(self->first_) == nullptr)
+                    self->first_ = YR_MEMORY_BLOCK{};
+            }
+
+            // Modules ask for the first block again once the walk is over
+            return self->first_.fetch_data != nullptr ? &self->first_
+                                                      : nullptr;
+        }
+
+        YR_MEMORY_BLOCK *Source::next(YR_MEMORY_BLOCK_ITERATOR *p_iterator)
+        {
+            auto *self = static_cast<Source *>(p_iterator->context);
+            return self->pull(self->current_);
+        }
+
+        uint64_t Source::file_size(YR_MEMORY_BLOCK_ITERATOR *p_iterator)
+        {
+            const auto *self = static_cast<Source *>(p_iterator->context);
+            return self->source_.size(self->source_.user_data);
+        }
+    } // namespace blocks
+} // namespace yara
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <yara/buffers.hxx>
+
+namespace yara
+{
+    Buffers::Buffers(size_t p_max_idle, size_t p_budget)
+        : max_idle_(p_max_idle), budget_(p_budget), idle_bytes_(0),
+          live_bytes_(0), closed_(false)
+    {
+    }
+
+    Buffer Buffers::take_locked(size_t p_size)
+    {
+        // Smallest idle buffer that fits, otherwise the largest one
+        // gets regrown so the pool does not keep growing in count
+        Buffer buffer;
+        auto fit = std::min_element(
+            idle_.begin(),
+            idle_.end(),
+            [p_size](const Buffer &a, const Buffer &b)
+            {
+                const bool a_fits = a.capacity >= p_size;
+                const bool b_fits = b.capacity >= p_size;
+                if (a_fits != b_fits)
+                    return a_fits;
+                return a_fits ? a.capacity < b.capacity
+                              : a.capacity > b.capacity;
+            });
+        if (fit != idle_.end())
+        {
+            buffer = std::move(*fit);
+            idle_.erase(fit);
+            idle_bytes_ -= buffer.capacity;
+        }
+
+        // Counted at the size it will have, the caller allocates it
+        if (buffer.capacity < p_size || !buffer.data)
+        {
+            buffer.data.reset();
+            buffer.capacity = std::max<size_t>(p_size, 1);
+        }
+        live_bytes_ += buffer.capacity;
+        return buffer;
+    }
+
+    const bool Buffers::fits_locked(size_t p_size)
+    {
+        const size_t size = std::max<size_t>(p_size, 1);
+        if (std::any_of(idle_.begin(),
+                        idle_.end(),
+                        [size](const Buffer &p_buffer)
+                        { return p_buffer.capacity >= size; }))
+            return true;
+
+        // A new buffer is needed, idle ones give their bytes back first
+        while (!idle_.empty() && live_bytes_ + idle_bytes_ + size > budget_)
+        {
+            const auto largest = std::max_element(
+                idle_.begin(),
+                idle_.end(),
+                [](const Buffer &a, const Buffer &b)
+                { return a.capacity < b.capacity; });
+            idle_bytes_ -= largest->capacity;
+            idle_.erase(largest);
+        }
+        return live_bytes_ == 0 || live_bytes_ + size <= budget_;
+    }
+
+    Buffer Buffers::acquire(size_t p_size)
+    {
+        Buffer buffer;
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            buffer = Buffers::take_locked(p_size);
+        }
+
+        // Allocate outside the lock, other threads keep using the pool
+        if (!buffer.data)
+            buffer.data.reset(new uint8_t[buffer.capacity]);
+        buffer.size = p_size;
+        return buffer;
+    }
+
+    std::optional<Buffer> Buffers::reserve(size_t p_size, bool p_wait)
+    {
+        Buffer buffer;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (budget_ != 0)
+            {
+                if (!p_wait && !Buffers::fits_locked(p_size))
+                    return std::nullopt;
+                released_.wait(
+                    lock,
+                    [this, p_size]()
+                    { return closed_ || Buffers::fits_locked(p_size); });
+            }
+            if (closed_)
+                return std::nullopt;
+            buffer = Buffers::take_locked(p_size);
+        }
+
+        if (!buffer.data)
+            buffer.data.reset(new uint8_t[buffer.capacity]);
+        buffer.size = p_size;
+        return buffer;
+    }
+
+    void Buffers::release(Buffer &&p_buffer)
+    {
+        if (!p_buffer.data)
+            return;
+
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            live_bytes_ -= p_buffer.capacity;
+            if (idle_bytes_ + p_buffer.capacity <= max_idle_)
+            {
+                p_buffer.size = 0;
+                idle_bytes_ += p_buffer.capacity;
+                idle_.push_back(std::move(p_buffer));
+            }
+        }
+        released_.notify_all();
+    }
+
+    void Buffers::close()
+    {
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        released_.notify_all();
+    }
+} // namespace yara
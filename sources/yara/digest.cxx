@@ -0,0 +1,197 @@
+#include <fmt/core.h>
+#include <iterator>
+#include <memory>
+#include <yara/digest.hxx>
+#include <yara/entitys.hxx>
+#include <yara/exception.hxx>
+
+#ifdef YARAL_HAVE_OPENSSL
+#include <openssl/evp.h>
+#endif
+
+#ifdef YARAL_HAVE_FUZZY
+#include <fuzzy.h>
+#endif
+
+namespace yara
+{
+    namespace
+    {
+        struct Evp
+        {
+            yara::type::Digest digest;
+            const char *name;
+        };
+
+        /* same order as Digests::contexts_ */
+        constexpr Evp EVPS[] = {{yara::type::Digest::Md5, "md5"},
+                                {yara::type::Digest::Sha1, "sha1"},
+                                {yara::type::Digest::Sha256, "sha256"}};
+
+#ifdef YARAL_HAVE_OPENSSL
+        const EVP_MD *evp_md(yara::type::Digest p_digest)
+        {
+            switch (p_digest)
+            {
+            case yara::type::Digest::Md5:
+                return EVP_md5();
+            case yara::type::Digest::Sha1:
+                return EVP_sha1();
+            default:
+                return EVP_sha256();
+            }
+        }
+#endif
+    } // namespace
+
+    Digests::Digests(uint32_t p_mask) : contexts_{}, fuzzy_(nullptr)
+    {
+        for (size_t i = 0; i < EVP; ++i)
+        {
+            if (!(p_mask & EVPS[i].digest))
+                continue;
+#ifdef YARAL_HAVE_OPENSSL
+            contexts_[i] = EVP_MD_CTX_new();
+            if (contexts_[i] == nullptr ||
+                EVP_DigestInit_ex(
+                    contexts_[i], evp_md(EVPS[i].digest), nullptr) != 1)
+            {
+                Digests::release();
+                throw yara::exception::Scan(fmt::format(
+                    "could not start the {} digest", EVPS[i].name));
+            }
+#else
+            throw yara::exception::Scan(fmt::format(
+                "{} digest needs a build with OpenSSL", EVPS[i].name));
+#endif
+        }
+
+        if (p_mask & yara::type::Digest::Ssdeep)
+        {
+#ifdef YARAL_HAVE_FUZZY
+            fuzzy_ = fuzzy_new();
+            if (fuzzy_ == nullptr)
+            {
+                Digests::release();
+                throw yara::exception::Scan(
+                    "could not start the ssdeep digest");
+            }
+#else
+            Digests::release();
+            throw yara::exception::Scan(
+                "ssdeep digest needs a build with libfuzzy");
+#endif
+        }
+    }
+
+    Digests::~Digests()
+    {
+        Digests::release();
+    }
+
+    void Digests::release()
+    {
+#ifdef YARAL_HAVE_OPENSSL
+        for (auto &context : contexts_)
+        {
+            EVP_MD_CTX_free(context);
+            context = nullptr;
+        }
+#endif
+#ifdef YARAL_HAVE_FUZZY
+        fuzzy_free(fuzzy_);
+        fuzzy_ = nullptr;
+#endif
+    }
+
+    void Digests::update(const uint8_t *p_data, size_t p_size)
+    {
+        if (p_size == 0)
+            return;
+
+#ifdef YARAL_HAVE_OPENSSL
+        for (auto *context : contexts_)
+        {
+            if (context != nullptr)
+                EVP_DigestUpdate(context, p_data, p_size);
+        }
+#endif
+#ifdef YARAL_HAVE_FUZZY
+        if (fuzzy_ != nullptr)
+            fuzzy_update(fuzzy_, p_data, p_size);
+#endif
+    }
+
+    DigestMap Digests::finish()
+    {
+        DigestMap digests;
+#ifdef YARAL_HAVE_OPENSSL
+        for (size_t i = 0; i < EVP; ++i)
+        {
+            if (contexts_[i] == nullptr)
+                continue;
+
+            unsigned char md[EVP_MAX_MD_SIZE];
+            unsigned int length = 0;
+            if (EVP_DigestFinal_ex(contexts_[i], md, &length) != 1)
+                continue;
+
+            std::string &hex = digests[EVPS[i].name];
+            hex.reserve(length * 2);
+            for (unsigned int b = 0; b < length; ++b)
+            {
+                fmt::format_to(std::back_inserter(hex), "{:02x}", md[b]);
+            }
+        }
+#endif
+#ifdef YARAL_HAVE_FUZZY
+        if (fuzzy_ != nullptr)
+        {
+            char result[FUZZY_MAX_RESULT];
+            if (fuzzy_digest(fuzzy_, result, 0) == 0)
+                digests["ssdeep"] = result;
+        }
+#endif
+        return digests;
+    }
+
+    std::future<DigestMap>
+    Digests::start(uint32_t p_mask, const uint8_t *p_data, size_t p_size)
+    {
+        // Built here so a missing backend throws before the scan starts
+        auto digests = std::make_shared<Digests>(p_mask);
+        return std::async(p_size >= OVERLAP ? std::launch::async
+                                            : std::launch::deferred,
+                          [digests, p_data, p_size]()
+                          {
+                              digests->update(p_data, p_size);
+                              return digests->finish();
+                          });
+    }
+
+    std::future<DigestMap>
+    Digests::start(uint32_t p_mask,
+                   const std::vector<std::string_view> &p_chunks)
+    {
+        auto digests = std::make_shared<Digests>(p_mask);
+        size_t size = 0;
+        for (const std::string_view chunk : p_chunks)
+        {
+            size += chunk.size();
+        }
+
+        return std::async(size >= OVERLAP ? std::launch::async
+                                          : std::launch::deferred,
+                          [digests, p_chunks]()
+                          {
+                              for (const std::string_view chunk : p_chunks)
+                              {
+                                  digests->update(
+                                      reinterpret_cast<const uint8_t *>(
+                                          chunk.data()),
+                                      chunk.size());
+                              }
+                              return digests->finish();
+                          });
+    }
+} // namespace yara
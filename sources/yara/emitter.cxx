@@ -0,0 +1,423 @@
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <iterator>
+#include <type_traits>
+#include <unistd.h>
+#include <variant>
+#include <yara/emitter.hxx>
+#include <yara/exception.hxx>
+
+namespace yara
+{
+    namespace
+    {
+        constexpr uint8_t BINARY_VERSION = 1;
+        /* version 1 followed by the digests */
+        constexpr uint8_t BINARY_VERSION_DIGESTS = 2;
+
+        /* length of the well formed UTF-8 sequence at p_at, 0 if it is not
+         * one: overlong forms, surrogates and code points past U+10FFFF
+         * are rejected */
+        size_t utf8_length(std::string_view p_value, size_t p_at)
+        {
+            const auto byte = [&](size_t p_offset) -> unsigned
+            {
+                return p_at + p_offset < p_value.size()
+                           ? static_cast<unsigned char>(
+                                 p_value[p_at + p_offset])
+                           : 0;
+            };
+            const auto continuation = [&](size_t p_offset,
+                                          unsigned p_low = 0x80,
+                                          unsigned p_high = 0xbf)
+            {
+                const unsigned b = byte(p_offset);
+                return b >= p_low && b <= p_high;
+            };
+
+            const unsigned lead = byte(0);
+            if (lead >= 0xc2 && lead <= 0xdf)
+                return continuation(1) ? 2 : 0;
+            if (lead >= 0xe0 && lead <= 0xef)
+            {
+                const bool second = lead == 0xe0   ? continuation(1, 0xa0)
+                                    : lead == 0xed ? continuation(1, 0x80, 0x9f)
+                                                   : continuation(1);
+                return second && continuation(2) ? 3 : 0;
+            }
+            if (lead >= 0xf0 && lead <= 0xf4)
+            {
+                const bool second = lead == 0xf0   ? continuation(1, 0x90)
+                                    : lead == 0xf4 ? continuation(1, 0x80, 0x8f)
+                                                   : continuation(1);
+                return second && continuation(2) && continuation(3) ? 4 : 0;
+            }
+            return 0;
+        }
+
+        /* paths, metas and namespaces are arbitrary bytes, a byte that is
+         * not part of valid UTF-8 is written as \u00XX so every record
+         * stays valid JSON */
+        void json_string(std::string &p_out, std::string_view p_value)
+        {
+            p_out.push_back('"');
+            for (size_t i = 0; i < p_value.size(); ++i)
+            {
+                const char c = p_value[i];
+                const auto byte = static_cast<unsigned char>(c);
+                switch (c)
+                {
+                case '"':
+                    p_out.append("\\\"");
+                    break;
+                case '\\':
+                    p_out.append("\\\\");
+                    break;
+                case '\n':
+                    p_out.append("\\n");
+                    break;
+                case '\r':
+                    p_out.append("\\r");
+                    break;
+                case '\t':
+                    p_out.append("\\t");
+                    break;
+                default:
+                    if (byte < 0x20)
+                    {
+                        fmt::format_to(
+                            std::back_inserter(p_out), "\\u{:04x}", byte);
+                    }
+                    else if (byte < 0x80)
+                    {
+                        p_out.push_back(c);
+                    }
+                    else if (const size_t length = utf8_length(p_value, i))
+                    {
+                        p_out.append(p_value.substr(i, length));
+                        i += length - 1;
+                    }
+                    else
+                    {
+                        fmt::format_to(
+                            std::back_inserter(p_out), "\\u{:04x}", byte);
+                    }
+                }
+            }
+            p_out.push_back('"');
+        }
+
+        template <typename T> void put(std::string &p_out, T p_value)
+        {
+            for (size_t i = 0; i < sizeof(T); ++i)
+            {
+                p_out.push_back(static_cast<char>(
+                    (static_cast<uint64_t>(p_value) >> (8 * i)) & 0xff));
+            }
+        }
+
+        void put_string(std::string &p_out, std::string_view p_value)
+        {
+            put<uint32_t>(p_out, static_cast<uint32_t>(p_value.size()));
+            p_out.append(p_value);
+        }
+
+        /* false when the descriptor is broken, EINTR and short writes retry */
+        bool write_all(int p_fd, const char *p_data, size_t p_size)
+        {
+            while (p_size > 0)
+            {
+                const ssize_t written = ::write(p_fd, p_data, p_size);
+                if (written < 0 && errno == EINTR)
+                    continue;
+                if (written <= 0)
+                    return false;
+                p_data += written;
+                p_size -= static_cast<size_t>(written);
+            }
+            return true;
+        }
+    } // namespace
+
+    Emitter::Emitter(int p_fd, const EmitterOptions &p_options)
+        : options_(p_options), fd_(p_fd), owned_(false), file_bytes_(0),
+          pending_records_(0)
+    {
+        if (fd_ < 0)
+        {
+            throw yara::exception::Scan(
+                fmt::format("Emitter() failed: invalid descriptor {}", p_fd));
+        }
+    }
+
+    Emitter::Emitter(const std::string &p_path,
+                     const EmitterOptions &p_options)
+        : options_(p_options), path_(p_path), fd_(-1), owned_(true),
+          file_bytes_(0), pending_records_(0)
+    {
+        Emitter::open_locked();
+        if (fd_ < 0)
+        {
+            throw yara::exception::Scan(fmt::format(
+                "Emitter() failed: could not open '{}', errno: {}",
+                p_path,
+                errno));
+        }
+    }
+
+    Emitter::~Emitter()
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        Emitter::flush_locked();
+        if (owned_ && fd_ >= 0)
+            close(fd_);
+    }
+
+    void Emitter::open_locked()
+    {
+        fd_ = ::open(path_.c_str(),
+                     O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                     0644);
+        file_bytes_ = 0;
+        if (fd_ >= 0)
+        {
+            const off_t end = lseek(fd_, 0, SEEK_END);
+            file_bytes_ = end > 0 ? static_cast<size_t>(end) : 0;
+        }
+    }
+
+    void Emitter::rotate_locked()
+    {
+        close(fd_);
+
+        // path.keep falls off, path.N moves to path.N+1, path to path.1
+        for (size_t i = options_.keep; i > 1; --i)
+        {
+            const std::string from = fmt::format("{}.{}", path_, i - 1);
+            const std::string to = fmt::format("{}.{}", path_, i);
+            std::rename(from.c_str(), to.c_str());
+        }
+        if (options_.keep > 0)
+            std::rename(path_.c_str(), fmt::format("{}.1", path_).c_str());
+        else
+            unlink(path_.c_str());
+
+        Emitter::open_locked();
+        ++stats_.rotations;
+    }
+
+    void Emitter::flush_locked()
+    {
+        if (batch_.empty())
+            return;
+
+        if (owned_ && options_.rotate != 0 && file_bytes_ != 0 &&
+            file_bytes_ + batch_.size() > options_.rotate)
+            Emitter::rotate_locked();
+
+        if (fd_ >= 0 && write_all(fd_, batch_.data(), batch_.size()))
+        {
+            file_bytes_ += batch_.size();
+            stats_.bytes += batch_.size();
+            ++stats_.writes;
+        }
+        else
+        {
+            stats_.dropped += pending_records_;
+            stats_.records -= pending_records_;
+        }
+        batch_.clear();
+        pending_records_ = 0;
+    }
+
+    void Emitter::emit(const yara::type::ScanResult &p_result)
+    {
+        // Encoded by the calling thread, only the append is serialized
+        thread_local std::string record;
+        record.clear();
+        if (options_.format == yara::type::Emit::Binary)
+            Emitter::encode_binary(record, p_result);
+        else
+            Emitter::encode_json(record, p_result);
+
+        const std::lock_guard<std::mutex> lock(mutex_);
+        batch_.append(record);
+        ++pending_records_;
+        ++stats_.records;
+        if (batch_.size() >= options_.batch)
+            Emitter::flush_locked();
+    }
+
+    void Emitter::flush()
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        Emitter::flush_locked();
+    }
+
+    EmitterStats Emitter::stats() const
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    void Emitter::encode_json(std::string &p_out,
+                              const yara::type::ScanResult &p_result)
+    {
+        p_out.append("{\"path\":");
+        json_string(p_out, p_result.path);
+        if (!p_result.error.empty())
+        {
+            p_out.append(",\"error\":");
+            json_string(p_out, p_result.error);
+        }
+
+        p_out.append(",\"matches\":[");
+        for (size_t i = 0; i < p_result.matches.size(); ++i)
+        {
+            const auto &match = p_result.matches[i];
+            if (i != 0)
+                p_out.push_back(',');
+
+            p_out.append("{\"rule\":");
+            json_string(p_out, match.identifier);
+            p_out.append(",\"namespace\":");
+            json_string(p_out, match.ns);
+
+            p_out.append(",\"tags\":[");
+            for (size_t t = 0; t < match.tags.size(); ++t)
+            {
+                if (t != 0)
+                    p_out.push_back(',');
+                json_string(p_out, match.tags[t]);
+            }
+
+            p_out.append("],\"metas\":{");
+            for (size_t m = 0; m < match.metas.size(); ++m)
+            {
+                if (m != 0)
+                    p_out.push_back(',');
+                json_string(p_out, match.metas[m].identifier);
+                p_out.push_back(':');
+                std::visit(
+                    [&p_out](const auto &p_value)
+                    {
+                        using T = std::decay_t<decltype(p_value)>;
+                        if constexpr (std::is_same_v<T, std::string>)
+                            json_string(p_out, p_value);
+                        else if constexpr (std::is_same_v<T, bool>)
+                            p_out.append(p_value ? "true" : "false");
+                        else
+                            fmt::format_to(
+                                std::back_inserter(p_out), "{}", p_value);
+                    },
+                    match.metas[m].value);
+            }
+
+            p_out.append("},\"strings\":[");
+            for (size_t s = 0; s < match.strings.size(); ++s)
+            {
+                const auto &string = match.strings[s];
+                if (s != 0)
+                    p_out.push_back(',');
+                p_out.append("{\"id\":");
+                json_string(p_out, string.identifier);
+                fmt::format_to(std::back_inserter(p_out),
+                               ",\"offset\":{},\"length\":{}}}",
+                               string.offset,
+                               string.length);
+            }
+            p_out.append("]}");
+        }
+        p_out.push_back(']');
+
+        if (!p_result.digests.empty())
+        {
+            p_out.append(",\"digests\":{");
+            bool first = true;
+            for (const auto &[name, digest] : p_result.digests)
+            {
+                if (!first)
+                    p_out.push_back(',');
+                first = false;
+                json_string(p_out, name);
+                p_out.push_back(':');
+                json_string(p_out, digest);
+            }
+            p_out.push_back('}');
+        }
+        p_out.append("}\n");
+    }
+
+    void Emitter::encode_binary(std::string &p_out,
+                                const yara::type::ScanResult &p_result)
+    {
+        // Length placeholder, patched once the record is complete
+        put<uint32_t>(p_out, 0);
+        put<uint8_t>(p_out,
+                     p_result.digests.empty() ? BINARY_VERSION
+                                              : BINARY_VERSION_DIGESTS);
+        put_string(p_out, p_result.path);
+        put_string(p_out, p_result.error);
+
+        put<uint32_t>(p_out, static_cast<uint32_t>(p_result.matches.size()));
+        for (const auto &match : p_result.matches)
+        {
+            put_string(p_out, match.identifier);
+            put_string(p_out, match.ns);
+
+            put<uint32_t>(p_out, static_cast<uint32_t>(match.tags.size()));
+            for (const auto &tag : match.tags)
+            {
+                put_string(p_out, tag);
+            }
+
+            put<uint32_t>(p_out, static_cast<uint32_t>(match.metas.size()));
+            for (const auto &meta : match.metas)
+            {
+                put_string(p_out, meta.identifier);
+                if (const auto *integer = std::get_if<int64_t>(&meta.value))
+                {
+                    put<uint8_t>(p_out, META_TYPE_INTEGER);
+                    put<int64_t>(p_out, *integer);
+                }
+                else if (const auto *boolean = std::get_if<bool>(&meta.value))
+                {
+                    put<uint8_t>(p_out, META_TYPE_BOOLEAN);
+                    put<uint8_t>(p_out, *boolean ? 1 : 0);
+                }
+                else
+                {
+                    put<uint8_t>(p_out, META_TYPE_STRING);
+                    put_string(p_out, std::get<std::string>(meta.value));
+                }
+            }
+
+            put<uint32_t>(p_out, static_cast<uint32_t>(match.strings.size()));
+            for (const auto &string : match.strings)
+            {
+                put_string(p_out, string.identifier);
+                put<uint64_t>(p_out, string.offset);
+                put<uint32_t>(p_out, string.length);
+            }
+        }
+
+        if (!p_result.digests.empty())
+        {
+            put<uint32_t>(p_out,
+                          static_cast<uint32_t>(p_result.digests.size()));
+            for (const auto &[name, digest] : p_result.digests)
+            {
+                put_string(p_out, name);
+                put_string(p_out, digest);
+            }
+        }
+
+        const auto length = static_cast<uint32_t>(p_out.size() - 4);
+        for (size_t i = 0; i < 4; ++i)
+        {
+            p_out[i] = static_cast<char>((length >> (8 * i)) & 0xff);
+        }
+    }
+} // namespace yara
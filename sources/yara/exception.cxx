@@ -57,5 +57,22 @@ namespace yara
         {
             return error_message_.c_str();
         }
+
+        Registry::Registry(const std::string &p_message)
+            : error_message_(p_message)
+        {
+        }
+        const char *Registry::what() const noexcept
+        {
+            return error_message_.c_str();
+        }
+
+        Ring::Ring(const std::string &p_message) : error_message_(p_message)
+        {
+        }
+        const char *Ring::what() const noexcept
+        {
+            return error_message_.c_str();
+        }
     } // namespace exception
 } // namespace yara
@@ -1,12 +1,569 @@
 #include <lua/lua.hxx>
 #include <lua/exception.hxx>
 #include <yara/extend/yara.hxx>
+#include <algorithm>
+#include <cstring>
 #include <fmt/core.h>
 #include <memory>
+#include <string_view>
+#include <utility>
+#include <yara/emitter.hxx>
+#include <yara/ingest.hxx>
+#include <yara/registry.hxx>
+#include <yara/ring.hxx>
+#include <yara/scheduler.hxx>
 #include <yara/yara.hxx>
 
 namespace yara::extend
 {
+    namespace
+    {
+        /* Lua backed YR_STREAM, read and write keep their own function
+         * and the owner of both is the Lua userdata itself */
+        struct Stream
+        {
+            YR_STREAM stream{};
+            sol::function read;
+            sol::function write;
+            std::exception_ptr pending;
+
+            YR_STREAM &get()
+            {
+                stream.user_data = static_cast<void *>(this);
+                stream.read = &Stream::on_read;
+                stream.write = &Stream::on_write;
+                pending = nullptr;
+                return stream;
+            }
+
+            void rethrow()
+            {
+                if (pending)
+                    std::rethrow_exception(std::exchange(pending, nullptr));
+            }
+
+            static size_t on_read(void *ptr,
+                                  size_t size,
+                                  size_t count,
+                                  void *user_data)
+            {
+                auto *self = static_cast<Stream *>(user_data);
+                if (!self || !self->read.valid() || size == 0)
+                    return 0;
+
+                try
+                {
+                    const size_t total_size = size * count;
+                    sol::protected_function_result result =
+                        self->read(total_size);
+                    if (!result.valid())
+                    {
+                        sol::error err = result;
+                        throw lua::exception::Runtime(
+                            fmt::format("Lua callback error: {}", err.what()));
+                    }
+
+                    const std::string_view data =
+                        result.get<std::string_view>();
+                    const size_t bytes_read = std::min(total_size, data.size());
+                    std::memcpy(ptr, data.data(), bytes_read);
+
+                    return bytes_read / size;
+                }
+                catch (...)
+                {
+                    // Never let exceptions escape through YARA's C code
+                    self->pending = std::current_exception();
+                    return 0;
+                }
+            }
+
+            static size_t on_write(const void *ptr,
+                                   size_t size,
+                                   size_t count,
+                                   void *user_data)
+            {
+                auto *self = static_cast<Stream *>(user_data);
+                if (!self || !self->write.valid())
+                    return 0;
+
+                try
+                {
+                    sol::protected_function_result result = self->write(
+                        std::string_view(static_cast<const char *>(ptr),
+                                         size * count));
+                    if (!result.valid())
+                    {
+                        sol::error err = result;
+                        throw lua::exception::Runtime(
+                            fmt::format("Lua callback error: {}", err.what()));
+                    }
+
+                    return count;
+                }
+                catch (...)
+                {
+                    self->pending = std::current_exception();
+                    return 0;
+                }
+            }
+        };
+
+        struct LuaScanData
+        {
+            sol::function *func;
+            std::exception_ptr pending;
+            const char *name;
+        };
+
+        /* trampoline shared by every scan entry point bound to Lua */
+        int scan_callback(YR_SCAN_CONTEXT *context,
+                          int message,
+                          void *message_data,
+                          void *user_data)
+        {
+            auto *d = static_cast<LuaScanData *>(user_data);
+            if (!d->func || !d->func->valid())
+                return CALLBACK_CONTINUE;
+            try
+            {
+                sol::protected_function_result result;
+                switch (message)
+                {
+                case CALLBACK_MSG_RULE_NOT_MATCHING:
+                case CALLBACK_MSG_RULE_MATCHING:
+                {
+                    const YR_RULE *rule =
+                        reinterpret_cast<YR_RULE *>(message_data);
+                    result = (*d->func)(message, rule);
+                    break;
+                }
+                case CALLBACK_MSG_SCAN_FINISHED:
+                    result = (*d->func)(message, sol::lua_nil);
+                    break;
+                case CALLBACK_MSG_TOO_MANY_MATCHES:
+                {
+                    const YR_STRING *string =
+                        reinterpret_cast<YR_STRING *>(message_data);
+                    result = (*d->func)(message, string);
+                    break;
+                }
+                case CALLBACK_MSG_CONSOLE_LOG:
+                {
+                    const char *log =
+                        reinterpret_cast<const char *>(message_data);
+                    result = (*d->func)(message, log);
+                    break;
+                }
+                default:
+                    result = (*d->func)(message);
+                    break;
+                }
+                if (!result.valid())
+                {
+                    sol::error err = result;
+                    throw lua::exception::Runtime(fmt::format(
+                        "Lua callback error in {}: {}", d->name, err.what()));
+                }
+                return static_cast<int>(result);
+            }
+            catch (...)
+            {
+                d->pending = std::current_exception();
+                return CALLBACK_ABORT;
+            }
+        }
+
+        /* module data blob created once in Lua and shared by scans */
+        struct ModuleData
+        {
+            yara::type::ModuleData data;
+
+            explicit ModuleData(const std::string &blob)
+                : data(std::make_shared<const std::string>(blob))
+            {
+            }
+        };
+
+        yara::type::ModuleData module_data(const sol::object &value)
+        {
+            if (value.is<ModuleData>())
+                return value.as<ModuleData &>().data;
+            if (value.get_type() == sol::type::string)
+                return std::make_shared<const std::string>(
+                    value.as<std::string>());
+            if (value.get_type() == sol::type::lua_nil)
+                return nullptr;
+            throw lua::exception::Runtime(
+                "module data must be a ModuleData, string or nil");
+        }
+
+        yara::type::Externals externals(const sol::table &table)
+        {
+            yara::type::Externals externals;
+            for (const auto &[key, value] : table)
+            {
+                const std::string name = key.as<std::string>();
+                switch (value.get_type())
+                {
+                case sol::type::boolean:
+                    externals.emplace(name, value.as<bool>());
+                    break;
+                case sol::type::number:
+                {
+                    lua_State *L = value.lua_state();
+                    value.push();
+                    const bool integer = lua_isinteger(L, -1);
+                    lua_pop(L, 1);
+                    if (integer)
+                        externals.emplace(name, value.as<int64_t>());
+                    else
+                        externals.emplace(name, value.as<double>());
+                    break;
+                }
+                case sol::type::string:
+                    externals.emplace(name, value.as<std::string>());
+                    break;
+                default:
+                    throw lua::exception::Runtime(fmt::format(
+                        "external variable '{}' must be a boolean, number or "
+                        "string",
+                        name));
+                }
+            }
+            return externals;
+        }
+
+        yara::type::BulkOptions bulk_options(
+            const sol::optional<sol::table> &options)
+        {
+            yara::type::BulkOptions bulk;
+            if (!options)
+                return bulk;
+
+            bulk.threads = options->get_or<size_t>("threads", bulk.threads);
+            bulk.depth = options->get_or<size_t>("depth", bulk.depth);
+            bulk.max_size =
+                options->get_or<size_t>("max_size", bulk.max_size);
+            bulk.max_inflight_bytes = options->get_or<size_t>(
+                "max_inflight_bytes", bulk.max_inflight_bytes);
+            return bulk;
+        }
+
+        sol::table issues(sol::state_view &lua,
+                          const std::vector<std::string> &list)
+        {
+            sol::table table = lua.create_table(list.size(), 0);
+            for (const auto &issue : list)
+            {
+                table.add(issue);
+            }
+            return table;
+        }
+
+        sol::table lint_report(sol::state_view &lua,
+                               const yara::LintReport &report)
+        {
+            sol::table rules = lua.create_table(report.rules.size(), 0);
+            for (const auto &rule : report.rules)
+            {
+                sol::table strings = lua.create_table(rule.strings.size(), 0);
+                for (const auto &string : rule.strings)
+                {
+                    strings.add(lua.create_table_with(
+                        "identifier", string.identifier,
+                        "kind", string.kind,
+                        "atom", string.atom,
+                        "quality", string.quality,
+                        "issues", issues(lua, string.issues)));
+                }
+                rules.add(lua.create_table_with(
+                    "identifier", rule.identifier,
+                    "namespace", rule.ns,
+                    "atoms", rule.atoms,
+                    "cost", rule.cost,
+                    "flagged", rule.flagged,
+                    "strings", strings,
+                    "issues", issues(lua, rule.issues)));
+            }
+
+            sol::table diagnostics =
+                lua.create_table(report.diagnostics.size(), 0);
+            for (const auto &diagnostic : report.diagnostics)
+            {
+                diagnostics.add(lua.create_table_with(
+                    "error", diagnostic.error,
+                    "file", diagnostic.file,
+                    "line", diagnostic.line,
+                    "rule", diagnostic.rule,
+                    "string", diagnostic.string,
+                    "message", diagnostic.message,
+                    "slow", diagnostic.slow));
+            }
+
+            return lua.create_table_with("compiled", report.compiled,
+                                         "flagged", report.flagged,
+                                         "rules", rules,
+                                         "diagnostics", diagnostics,
+                                         "text", yara::Linter::dump(report));
+        }
+
+        /* keeps the Yara userdata alive while its workers scan */
+        struct Scheduler
+        {
+            sol::object owner;
+            std::unique_ptr<yara::Scheduler> scheduler;
+        };
+
+        yara::LaneOptions lane_options(const sol::table &options,
+                                       const char *name,
+                                       yara::LaneOptions lane)
+        {
+            const sol::optional<sol::table> table = options[name];
+            if (!table)
+                return lane;
+
+            lane.workers = table->get_or<size_t>("workers", lane.workers);
+            lane.capacity = table->get_or<size_t>("capacity", lane.capacity);
+            return lane;
+        }
+
+        yara::SchedulerOptions
+        scheduler_options(const sol::optional<sol::table> &options)
+        {
+            yara::SchedulerOptions scheduler;
+            if (!options)
+                return scheduler;
+
+            scheduler.fast = lane_options(*options, "fast", scheduler.fast);
+            scheduler.bulk = lane_options(*options, "bulk", scheduler.bulk);
+            scheduler.priority =
+                lane_options(*options, "priority", scheduler.priority);
+            scheduler.fast_limit =
+                options->get_or<size_t>("fast_limit", scheduler.fast_limit);
+            scheduler.steal_pressure = options->get_or<double>(
+                "steal_pressure", scheduler.steal_pressure);
+            scheduler.results =
+                options->get_or<size_t>("results", scheduler.results);
+            return scheduler;
+        }
+
+        sol::table latency_report(sol::state_view &lua,
+                                  const yara::LatencyReport &report)
+        {
+            return lua.create_table_with("count", report.count,
+                                         "seconds", report.seconds,
+                                         "per_second", report.per_second,
+                                         "p50_ns", report.p50_ns,
+                                         "p90_ns", report.p90_ns,
+                                         "p99_ns", report.p99_ns,
+                                         "p999_ns", report.p999_ns,
+                                         "max_ns", report.max_ns);
+        }
+
+        sol::object job_id(sol::state_view &lua, uint64_t id)
+        {
+            // nil tells the caller the lane is full
+            if (id == 0)
+                return sol::make_object(lua, sol::lua_nil);
+            return sol::make_object(lua, id);
+        }
+
+        /* keeps the Yara userdata alive while its workers scan the ring */
+        struct Ingest
+        {
+            sol::object owner;
+            std::unique_ptr<yara::Ingest> ingest;
+        };
+
+        /* producer end of a ring, the stand-in for an external process */
+        struct Ring
+        {
+            std::unique_ptr<yara::Ring> ring;
+        };
+
+        yara::IngestOptions
+        ingest_options(const sol::optional<sol::table> &options)
+        {
+            yara::IngestOptions ingest;
+            if (!options)
+                return ingest;
+
+            ingest.threads = options->get_or<size_t>("threads", ingest.threads);
+            ingest.create = options->get_or<bool>("create", ingest.create);
+            ingest.slots = options->get_or<uint32_t>("slots", ingest.slots);
+            ingest.slot_size =
+                options->get_or<size_t>("slot_size", ingest.slot_size);
+            return ingest;
+        }
+
+        sol::table ring_verdict(sol::state_view &lua,
+                                yara::RingVerdict &&verdict)
+        {
+            sol::table table =
+                lua.create_table_with("id", verdict.id,
+                                      "matches", verdict.matches,
+                                      "truncated", verdict.truncated,
+                                      "rules", sol::as_table(
+                                                   std::move(verdict.rules)));
+            if (!verdict.error.empty())
+                table["error"] = std::move(verdict.error);
+            return table;
+        }
+
+        yara::type::ArchiveLimits archive_limits(
+            const sol::optional<sol::table> &options)
+        {
+            yara::type::ArchiveLimits limits;
+            if (!options)
+                return limits;
+
+            limits.depth = options->get_or<size_t>("depth", limits.depth);
+            limits.members =
+                options->get_or<size_t>("members", limits.members);
+            limits.expanded =
+                options->get_or<size_t>("expanded", limits.expanded);
+            limits.member_size =
+                options->get_or<size_t>("member_size", limits.member_size);
+            limits.ratio = options->get_or<size_t>("ratio", limits.ratio);
+            return limits;
+        }
+
+        sol::table exit_report(sol::state_view &lua,
+                               const yara::type::ExitReport &report)
+        {
+            sol::table table = lua.create_table_with("stopped", report.stopped,
+                                                     "matched", report.matched,
+                                                     "reported", report.reported,
+                                                     "skipped", report.skipped,
+                                                     "total", report.total);
+            if (report.stopped)
+                table["rule"] = report.rule;
+            return table;
+        }
+
+        /* what scan_bytes and scan_file return once the scan is over */
+        sol::table scan_report(sol::state_view &lua)
+        {
+            sol::table table = exit_report(lua, yara::Yara::last_exit());
+            const yara::DigestMap &digests = yara::Yara::last_digests();
+            if (!digests.empty())
+                table["digests"] = sol::as_table(digests);
+            return table;
+        }
+
+        sol::table scan_result(sol::state_view &lua,
+                               yara::type::ScanResult &&result)
+        {
+            sol::table matches = lua.create_table(result.matches.size(), 0);
+            for (auto &match : result.matches)
+            {
+                matches.add(lua.create_table_with(
+                    "identifier",
+                    std::move(match.identifier),
+                    "namespace",
+                    std::move(match.ns)));
+            }
+
+            sol::table table = lua.create_table_with(
+                "path", std::move(result.path), "matches", matches);
+            if (!result.error.empty())
+                table["error"] = std::move(result.error);
+            if (result.exit.stopped)
+                table["exit"] = exit_report(lua, result.exit);
+            if (!result.digests.empty())
+                table["digests"] = sol::as_table(std::move(result.digests));
+            return table;
+        }
+
+        /* sources accepted by compile_async and share_rules, a path or a
+         * table with path or buffer and an optional namespace */
+        std::vector<yara::type::RuleSource> rule_sources(
+            const sol::table &table)
+        {
+            std::vector<yara::type::RuleSource> sources;
+            for (const auto &[key, value] : table)
+            {
+                yara::type::RuleSource source;
+                if (value.get_type() == sol::type::string)
+                {
+                    source.path = value.as<std::string>();
+                }
+                else if (value.get_type() == sol::type::table)
+                {
+                    const sol::table entry = value.as<sol::table>();
+                    source.path = entry.get_or<std::string>("path", {});
+                    source.buffer = entry.get_or<std::string>("buffer", {});
+                    source.ns = entry.get_or<std::string>("namespace", {});
+                }
+                else
+                {
+                    throw lua::exception::Runtime(
+                        "rule sources must be paths or tables");
+                }
+                sources.push_back(std::move(source));
+            }
+            return sources;
+        }
+
+        /* options table accepted by the scan functions */
+        yara::type::ScanOptions scan_options(
+            const sol::optional<sol::table> &options)
+        {
+            yara::type::ScanOptions scan_options;
+            if (!options)
+                return scan_options;
+
+            if (sol::optional<sol::table> table =
+                    (*options)["externals"])
+            {
+                scan_options.externals = externals(*table);
+            }
+            if (sol::optional<std::string> scan_class =
+                    (*options)["scan_class"])
+            {
+                scan_options.scan_class = std::move(*scan_class);
+            }
+            if (sol::optional<sol::table> table =
+                    (*options)["module_data"])
+            {
+                for (const auto &[key, value] : *table)
+                {
+                    scan_options.module_data.emplace(key.as<std::string>(),
+                                                     module_data(value));
+                }
+            }
+            if (sol::optional<std::shared_ptr<yara::Emitter>> emitter =
+                    (*options)["emitter"])
+            {
+                scan_options.emitter = std::move(*emitter);
+            }
+            if (sol::optional<std::string> name = (*options)["name"])
+            {
+                scan_options.name = std::move(*name);
+            }
+            if (sol::optional<sol::table> table = (*options)["exit"])
+            {
+                yara::type::ExitPolicy &exit = scan_options.exit;
+                exit.matches = table->get_or<size_t>("matches", exit.matches);
+                exit.tag = table->get_or<std::string>("tag", exit.tag);
+                exit.meta = table->get_or<std::string>("meta", exit.meta);
+                exit.meta_min =
+                    table->get_or<int64_t>("meta_min", exit.meta_min);
+                exit.meta_value =
+                    table->get_or<std::string>("meta_value", exit.meta_value);
+            }
+            if (sol::optional<sol::table> table = (*options)["digests"])
+            {
+                for (const auto &[key, value] : *table)
+                {
+                    scan_options.digests |= value.as<yara::type::Digest>();
+                }
+            }
+            return scan_options;
+        }
+    } // namespace
+
     Yara::Yara(lua::Lua &lua) : lua_(lua) 
     {
 
@@ -48,6 +605,39 @@ namespace yara::extend
              {"ReportRulesMatching", yara::type::Flags::ReportRulesMatching},
              {"ReportRulesNotMatching",
               yara::type::Flags::ReportRulesNotMatching}});
+
+        lua_.state.new_enum<yara::type::Compile>(
+            "YaraCompile",
+            {{"Progress", yara::type::Compile::Progress},
+             {"Warning", yara::type::Compile::Warning},
+             {"Error", yara::type::Compile::Error},
+             {"Installed", yara::type::Compile::Installed},
+             {"Failed", yara::type::Compile::Failed}});
+
+        lua_.state.new_enum<yara::type::Emit>(
+            "YaraEmit",
+            {{"JsonLines", yara::type::Emit::JsonLines},
+             {"Binary", yara::type::Emit::Binary}});
+
+        lua_.state.new_enum<yara::type::Lane>(
+            "YaraLane",
+            {{"Fast", yara::type::Lane::Fast},
+             {"Bulk", yara::type::Lane::Bulk},
+             {"Priority", yara::type::Lane::Priority},
+             {"Auto", yara::type::Lane::Auto}});
+
+        lua_.state.new_enum<yara::type::RuleKey>(
+            "YaraRuleKey",
+            {{"Identifier", yara::type::RuleKey::Identifier},
+             {"Tag", yara::type::RuleKey::Tag},
+             {"Namespace", yara::type::RuleKey::Namespace}});
+
+        lua_.state.new_enum<yara::type::Digest>(
+            "YaraDigest",
+            {{"Md5", yara::type::Digest::Md5},
+             {"Sha1", yara::type::Digest::Sha1},
+             {"Sha256", yara::type::Digest::Sha256},
+             {"Ssdeep", yara::type::Digest::Ssdeep}});
     }
 
     void Yara::bind_match()
@@ -150,94 +740,281 @@ namespace yara::extend
 
     void Yara::bind_stream()
     {
-        lua_.state.new_usertype<YR_STREAM>(
+        lua_.state.new_usertype<Stream>(
             "Stream",
             "new",
-            sol::constructors<YR_STREAM()>(),
+            sol::constructors<Stream()>(),
             "read",
-            [](YR_STREAM &stream, sol::function func)
-            {
-                auto func_ptr =
-                    std::make_shared<sol::function>(std::move(func));
+            [](Stream &stream, sol::function func)
+            { stream.read = std::move(func); },
+            "write",
+            [](Stream &stream, sol::function func)
+            { stream.write = std::move(func); });
+    }
 
-                stream.user_data = static_cast<void *>(
-                    new std::shared_ptr<sol::function>(func_ptr));
+    void Yara::bind_module_data()
+    {
+        lua_.state.new_usertype<ModuleData>(
+            "ModuleData",
+            "new",
+            sol::constructors<ModuleData(const std::string &)>(),
+            "size",
+            sol::property([](const ModuleData &m)
+                          { return m.data->size(); }));
+    }
 
-                stream.read = [](void *ptr,
-                                 size_t size,
-                                 size_t count,
-                                 void *user_data) -> size_t
+    void Yara::bind_registry()
+    {
+        sol::table registry = lua_.state.create_named_table("YaraRegistry");
+        registry.set_function(
+            "entries",
+            [](sol::this_state state)
+            {
+                sol::state_view lua(state);
+                const auto entries = yara::Registry::instance().entries();
+                sol::table table = lua.create_table(entries.size(), 0);
+                for (const auto &entry : entries)
                 {
-                    if (!user_data)
-                    {
-                        throw lua::exception::Runtime(
-                            "Callback not valid (null user_data)");
-                    }
-
-                    auto *func_shared_ptr =
-                        static_cast<std::shared_ptr<sol::function> *>(
-                            user_data);
-                    sol::function &lua_read_func = **func_shared_ptr;
-
-                    const size_t total_size = size * count;
+                    table.add(lua.create_table_with("name", entry.name,
+                                                    "version", entry.version,
+                                                    "bytes", entry.bytes,
+                                                    "attached",
+                                                    entry.attached));
+                }
+                return table;
+            });
+        registry.set_function(
+            "bytes", []() { return yara::Registry::instance().bytes(); });
+        registry.set_function(
+            "unpublish",
+            [](const std::string &name, sol::optional<uint64_t> version)
+            {
+                return yara::Registry::instance().unpublish(
+                    name, version.value_or(0));
+            });
+    }
 
-                    sol::protected_function_result result =
-                        lua_read_func(total_size);
-                    if (!result.valid())
+    void Yara::bind_emitter()
+    {
+        lua_.state.new_usertype<yara::Emitter>(
+            "Emitter",
+            "new",
+            sol::factories(
+                [](sol::object target, sol::optional<sol::table> options)
+                {
+                    yara::EmitterOptions emitter;
+                    if (options)
                     {
-                        sol::error err = result;
-                        throw lua::exception::Runtime(
-                            fmt::format("Lua callback error: {}", err.what()));
+                        emitter.format = options->get_or(
+                            "format", yara::type::Emit::JsonLines);
+                        emitter.batch =
+                            options->get_or<size_t>("batch", emitter.batch);
+                        emitter.rotate =
+                            options->get_or<size_t>("rotate", emitter.rotate);
+                        emitter.keep =
+                            options->get_or<size_t>("keep", emitter.keep);
                     }
 
-                    const std::string data = result.get<std::string>();
-                    size_t bytes_read = std::min(total_size, data.size());
+                    if (target.get_type() == sol::type::number)
+                        return std::make_shared<yara::Emitter>(
+                            target.as<int>(), emitter);
+                    if (target.get_type() == sol::type::string)
+                        return std::make_shared<yara::Emitter>(
+                            target.as<std::string>(), emitter);
+                    throw lua::exception::Runtime(
+                        "Emitter.new() expects a path or a file descriptor");
+                }),
+            "flush",
+            &yara::Emitter::flush,
+            "stats",
+            [](const yara::Emitter &self, sol::this_state state)
+            {
+                sol::state_view lua(state);
+                const yara::EmitterStats stats = self.stats();
+                return lua.create_table_with("records", stats.records,
+                                             "bytes", stats.bytes,
+                                             "writes", stats.writes,
+                                             "rotations", stats.rotations,
+                                             "dropped", stats.dropped);
+            });
+    }
 
-                    std::memcpy(ptr, data.data(), bytes_read);
+    void Yara::bind_scheduler()
+    {
+        lua_.state.new_usertype<Scheduler>(
+            "Scheduler",
+            "new",
+            sol::factories(
+                [](sol::object owner, sol::optional<sol::table> options)
+                {
+                    if (!owner.is<yara::Yara>())
+                        throw lua::exception::Runtime(
+                            "Scheduler.new() expects a Yara object");
 
-                    return bytes_read / size;
-                };
+                    Scheduler handle;
+                    handle.scheduler = std::make_unique<yara::Scheduler>(
+                        owner.as<yara::Yara &>(), scheduler_options(options));
+                    handle.owner = std::move(owner);
+                    return handle;
+                }),
+            "submit_bytes",
+            [](Scheduler &self,
+               std::string buffer,
+               yara::type::Lane lane,
+               yara::type::Flags flags,
+               sol::optional<sol::table> options,
+               sol::this_state state)
+            {
+                sol::state_view lua(state);
+                const std::string name =
+                    options ? options->get_or<std::string>("name", "")
+                            : std::string();
+                return job_id(lua,
+                              self.scheduler->submit_bytes(
+                                  std::move(buffer),
+                                  name,
+                                  lane,
+                                  flags,
+                                  scan_options(options)));
             },
-            "write",
-            [](YR_STREAM &stream, sol::function func)
+            "submit_file",
+            [](Scheduler &self,
+               const std::string &path,
+               yara::type::Lane lane,
+               yara::type::Flags flags,
+               sol::optional<sol::table> options,
+               sol::this_state state)
             {
-                auto func_ptr =
-                    std::make_shared<sol::function>(std::move(func));
+                sol::state_view lua(state);
+                return job_id(lua,
+                              self.scheduler->submit_file(
+                                  path, lane, flags, scan_options(options)));
+            },
+            "poll",
+            [](Scheduler &self,
+               sol::optional<size_t> max,
+               sol::optional<int64_t> timeout_ms,
+               sol::this_state state)
+            {
+                sol::state_view lua(state);
+                auto jobs = self.scheduler->poll(
+                    max.value_or(0),
+                    std::chrono::milliseconds(timeout_ms.value_or(0)));
 
-                stream.user_data = static_cast<void *>(
-                    new std::shared_ptr<sol::function>(func_ptr));
+                sol::table table = lua.create_table(jobs.size(), 0);
+                for (auto &job : jobs)
+                {
+                    sol::table result =
+                        scan_result(lua, std::move(job.result));
+                    result["id"] = job.id;
+                    result["lane"] = job.lane;
+                    result["wait_ns"] = job.wait_ns;
+                    result["service_ns"] = job.service_ns;
+                    table.add(result);
+                }
+                return table;
+            },
+            "outstanding",
+            [](const Scheduler &self)
+            { return self.scheduler->outstanding(); },
+            "pressure",
+            [](const Scheduler &self, yara::type::Lane lane)
+            { return self.scheduler->pressure(lane); },
+            "stats",
+            [](const Scheduler &self,
+               yara::type::Lane lane,
+               sol::this_state state)
+            {
+                sol::state_view lua(state);
+                const yara::LaneStats stats = self.scheduler->stats(lane);
+                return lua.create_table_with(
+                    "queued", stats.queued,
+                    "capacity", stats.capacity,
+                    "workers", stats.workers,
+                    "submitted", stats.submitted,
+                    "rejected", stats.rejected,
+                    "completed", stats.completed,
+                    "wait", latency_report(lua, stats.wait),
+                    "service", latency_report(lua, stats.service));
+            },
+            "close",
+            [](Scheduler &self) { self.scheduler->close(); });
+    }
 
-                stream.write = [](const void *ptr,
-                                  size_t size,
-                                  size_t count,
-                                  void *user_data) -> size_t
+    void Yara::bind_ingest()
+    {
+        lua_.state.new_usertype<Ingest>(
+            "Ingest",
+            "new",
+            sol::factories(
+                [](sol::object owner,
+                   const std::string &name,
+                   yara::type::Flags flags,
+                   sol::optional<sol::table> options)
                 {
-                    if (!user_data)
-                    {
+                    if (!owner.is<yara::Yara>())
                         throw lua::exception::Runtime(
-                            "Callback not valid (null user_data)");
-                    }
-
-                    auto *func_shared_ptr =
-                        static_cast<std::shared_ptr<sol::function> *>(
-                            user_data);
-                    sol::function &lua_write_func = **func_shared_ptr;
+                            "Ingest.new() expects a Yara object");
 
-                    const size_t total_size = size * count;
-                    std::string data(static_cast<const char *>(ptr),
-                                     total_size);
-
-                    sol::protected_function_result result =
-                        lua_write_func(data);
-                    if (!result.valid())
-                    {
-                        sol::error err = result;
-                        throw lua::exception::Runtime(
-                            fmt::format("Lua callback error: {}", err.what()));
-                    }
+                    Ingest handle;
+                    handle.ingest = std::make_unique<yara::Ingest>(
+                        owner.as<yara::Yara &>(),
+                        name,
+                        flags,
+                        ingest_options(options),
+                        scan_options(options));
+                    handle.owner = std::move(owner);
+                    return handle;
+                }),
+            "name",
+            [](const Ingest &self) { return self.ingest->ring().name(); },
+            "stats",
+            [](const Ingest &self, sol::this_state state)
+            {
+                sol::state_view lua(state);
+                const yara::IngestStats stats = self.ingest->stats();
+                return lua.create_table_with(
+                    "scanned", stats.scanned,
+                    "failed", stats.failed,
+                    "matched", stats.matched,
+                    "service", latency_report(lua, stats.service));
+            },
+            "stop",
+            [](Ingest &self) { self.ingest->stop(); });
 
-                    return count;
-                };
+        lua_.state.new_usertype<Ring>(
+            "Ring",
+            "create",
+            sol::factories(
+                [](const std::string &name,
+                   uint32_t slots,
+                   size_t slot_size)
+                { return Ring{yara::Ring::create(name, slots, slot_size)}; }),
+            "open",
+            sol::factories([](const std::string &name)
+                           { return Ring{yara::Ring::open(name)}; }),
+            "slots",
+            [](const Ring &self) { return self.ring->slots(); },
+            "slot_size",
+            [](const Ring &self) { return self.ring->slot_size(); },
+            "submit",
+            [](Ring &self, std::string_view data, uint64_t id)
+            { return self.ring->submit(data, id); },
+            "collect",
+            [](Ring &self, sol::optional<size_t> max, sol::this_state state)
+            {
+                sol::state_view lua(state);
+                const size_t limit = max.value_or(0);
+                sol::table table = lua.create_table();
+                while (limit == 0 || table.size() < limit)
+                {
+                    std::optional<yara::RingVerdict> verdict =
+                        self.ring->collect();
+                    if (!verdict)
+                        break;
+                    table.add(ring_verdict(lua, std::move(*verdict)));
+                }
+                return table;
             });
     }
 
@@ -248,13 +1025,64 @@ namespace yara::extend
             "new",
             sol::constructors<yara::Yara()>(),
             "rule_disable",
-            &yara::Yara::rule_disable,
+            sol::overload(&yara::Yara::rule_disable,
+                          [](yara::Yara &self, const std::string &identifier)
+                          {
+                              return self.rules_disable(
+                                  yara::type::Identifier, identifier);
+                          }),
             "rule_enable",
-            &yara::Yara::rule_enable,
+            sol::overload(&yara::Yara::rule_enable,
+                          [](yara::Yara &self, const std::string &identifier)
+                          {
+                              return self.rules_enable(yara::type::Identifier,
+                                                       identifier);
+                          }),
+            "rules_disable",
+            &yara::Yara::rules_disable,
+            "rules_enable",
+            &yara::Yara::rules_enable,
+            "rules_find",
+            [](const yara::Yara &self,
+               yara::type::RuleKey key,
+               const std::string &name)
+            { return sol::as_table(self.rules_find(key, name)); },
+            "rules_toggled",
+            [](const yara::Yara &self, sol::this_state state)
+            {
+                sol::state_view lua(state);
+                const auto toggles = self.rules_toggled();
+                sol::table table = lua.create_table(toggles.size(), 0);
+                for (const auto &toggle : toggles)
+                {
+                    table.add(lua.create_table_with("key", toggle.key,
+                                                    "name", toggle.name,
+                                                    "disabled",
+                                                    toggle.disabled));
+                }
+                return table;
+            },
+            "rules_toggled_clear",
+            &yara::Yara::rules_toggled_clear,
             "unload_rules",
             &yara::Yara::unload_rules,
             "load_rules_stream",
-            &yara::Yara::load_rules_stream,
+            [](yara::Yara &self, Stream &stream)
+            {
+                const int error_success =
+                    self.load_rules_stream(stream.get());
+                stream.rethrow();
+                return error_success;
+            },
+            "load_rules_bytes",
+            [](yara::Yara &self, std::string_view buffer)
+            { return self.load_rules_bytes(buffer); },
+            "load_rules_fd",
+            &yara::Yara::load_rules_fd,
+            "save_rules_fd",
+            &yara::Yara::save_rules_fd,
+            "load_rules_mmap",
+            &yara::Yara::load_rules_mmap,
             "rules_foreach",
             &yara::Yara::rules_foreach,
             "metas_foreach",
@@ -264,7 +1092,13 @@ namespace yara::extend
             "strings_foreach",
             &yara::Yara::strings_foreach,
             "save_rules_stream",
-            &yara::Yara::save_rules_stream,
+            [](yara::Yara &self, Stream &stream)
+            {
+                const int error_success =
+                    self.save_rules_stream(stream.get());
+                stream.rethrow();
+                return error_success;
+            },
             "load_compiler",
             &yara::Yara::load_compiler,
             "unload_compiler",
@@ -273,93 +1107,155 @@ namespace yara::extend
             &yara::Yara::set_rules_folder,
             "load_rules",
             &yara::Yara::load_rules,
+            "compile_async",
+            [](yara::Yara &self, const sol::table &sources)
+            { self.compile_async(rule_sources(sources)); },
+            "lint",
+            [](yara::Yara &self,
+               const sol::table &sources,
+               sol::optional<sol::table> options,
+               sol::this_state state)
+            {
+                sol::state_view lua(state);
+                yara::LintOptions lint;
+                if (options)
+                {
+                    lint.min_quality =
+                        options->get_or("min_quality", lint.min_quality);
+                    lint.max_jump =
+                        options->get_or<size_t>("max_jump", lint.max_jump);
+                    lint.max_atoms =
+                        options->get_or<size_t>("max_atoms", lint.max_atoms);
+                }
+                return lint_report(
+                    lua, self.lint(rule_sources(sources), lint));
+            },
+            "compile_poll",
+            [](yara::Yara &self, sol::this_state state)
+            {
+                sol::state_view lua(state);
+                sol::table events = lua.create_table();
+                for (auto &event : self.compile_poll())
+                {
+                    events.add(lua.create_table_with("type",
+                                                     event.type,
+                                                     "file",
+                                                     std::move(event.file),
+                                                     "line",
+                                                     event.line,
+                                                     "message",
+                                                     std::move(event.message),
+                                                     "done",
+                                                     event.done,
+                                                     "total",
+                                                     event.total,
+                                                     "rule",
+                                                     std::move(event.rule)));
+                }
+                return events;
+            },
+            "compiling",
+            &yara::Yara::compiling,
+            "watch_rules",
+            [](yara::Yara &self,
+               const std::string &path,
+               sol::optional<int64_t> debounce_ms)
+            {
+                self.watch_rules(
+                    path, std::chrono::milliseconds(debounce_ms.value_or(500)));
+            },
+            "unwatch_rules",
+            &yara::Yara::unwatch_rules,
+            "watching",
+            &yara::Yara::watching,
             "scan_bytes",
             [](yara::Yara &self,
                const std::string &buffer,
                sol::function func,
-               yara::type::Flags flags)
+               yara::type::Flags flags,
+               sol::optional<sol::table> options,
+               sol::this_state state) -> sol::object
             {
-                if (!func.valid())
+                sol::state_view lua(state);
+                // With an emitter the callback is optional
+                const yara::type::ScanOptions scan = scan_options(options);
+                if (!func.valid() && !scan.emitter)
                 {
-                    return;
+                    return sol::make_object(lua, sol::lua_nil);
                 }
-                struct LuaScanData
-                {
-                    sol::function *func;
-                    std::exception_ptr pending;
-                };
-                LuaScanData cbData{&func, nullptr};
-                self.scan_bytes(
-                    buffer,
-                    +[](YR_SCAN_CONTEXT *context,
-                        int message,
-                        void *message_data,
-                        void *user_data) -> int
-                    {
-                        auto *d = static_cast<LuaScanData *>(user_data);
-                        if (!d->func || !d->func->valid())
-                            return CALLBACK_CONTINUE;
-                        try
-                        {
-                            sol::protected_function_result result;
-                            switch (message)
-                            {
-                            case CALLBACK_MSG_RULE_NOT_MATCHING:
-                            case CALLBACK_MSG_RULE_MATCHING:
-                            {
-                                const YR_RULE *rule =
-                                    reinterpret_cast<YR_RULE *>(message_data);
-                                result = (*d->func)(message, rule);
-                                break;
-                            }
-                            case CALLBACK_MSG_SCAN_FINISHED:
-                                result = (*d->func)(message, sol::lua_nil);
-                                break;
-                            case CALLBACK_MSG_TOO_MANY_MATCHES:
-                            {
-                                const YR_STRING *string =
-                                    reinterpret_cast<YR_STRING *>(message_data);
-                                result = (*d->func)(message, string);
-                                break;
-                            }
-                            case CALLBACK_MSG_CONSOLE_LOG:
-                            {
-                                const char *log =
-                                    reinterpret_cast<const char *>(message_data);
-                                result = (*d->func)(message, log);
-                                break;
-                            }
-                            case CALLBACK_MSG_IMPORT_MODULE:
-                            {
-                                const YR_MODULE_IMPORT *module_import =
-                                    reinterpret_cast<YR_MODULE_IMPORT *>(
-                                        message_data);
-                                result = (*d->func)(message, module_import);
-                                break;
-                            }
-                            default:
-                                result = (*d->func)(message);
-                                break;
-                            }
-                            if (!result.valid())
-                            {
-                                sol::error err = result;
-                                throw lua::exception::Runtime(fmt::format(
-                                    "Lua callback error in scan_bytes: {}",
-                                    err.what()));
-                            }
-                            return static_cast<int>(result);
-                        }
-                        catch (...)
-                        {
-                            d->pending = std::current_exception();
-                            return CALLBACK_ABORT;
-                        }
-                    },
+                LuaScanData cbData{&func, nullptr, "scan_bytes"};
+                self.scan_bytes(buffer,
+                                &scan_callback,
+                                static_cast<void *>(&cbData),
+                                flags,
+                                scan);
+                if (cbData.pending)
+                    std::rethrow_exception(cbData.pending);
+                return scan_report(lua);
+            },
+            "scan_chunks",
+            [](yara::Yara &self,
+               const sol::table &chunks,
+               sol::function func,
+               yara::type::Flags flags,
+               sol::optional<sol::table> options,
+               sol::this_state state) -> sol::object
+            {
+                sol::state_view lua(state);
+                const yara::type::ScanOptions scan = scan_options(options);
+                if (!func.valid() && !scan.emitter)
+                {
+                    return sol::make_object(lua, sol::lua_nil);
+                }
+
+                // The table keeps the strings alive, views are enough
+                std::vector<std::string_view> views;
+                views.reserve(chunks.size());
+                for (size_t i = 1; i <= chunks.size(); ++i)
+                {
+                    const sol::object chunk = chunks[i];
+                    if (chunk.get_type() != sol::type::string)
+                        throw lua::exception::Runtime(
+                            "scan_chunks() expects a table of strings");
+                    views.push_back(chunk.as<std::string_view>());
+                }
+
+                LuaScanData cbData{&func, nullptr, "scan_chunks"};
+                self.scan_chunks(views,
+                                 &scan_callback,
+                                 static_cast<void *>(&cbData),
+                                 flags,
+                                 scan);
+                if (cbData.pending)
+                    std::rethrow_exception(cbData.pending);
+                return scan_report(lua);
+            },
+            "scan_source",
+            [](yara::Yara &self,
+               sol::lightuserdata_value source,
+               sol::function func,
+               yara::type::Flags flags,
+               sol::optional<sol::table> options,
+               sol::this_state state) -> sol::object
+            {
+                sol::state_view lua(state);
+                const yara::type::ScanOptions scan = scan_options(options);
+                if ((!func.valid() && !scan.emitter) ||
+                    source.value == nullptr)
+                {
+                    return sol::make_object(lua, sol::lua_nil);
+                }
+
+                LuaScanData cbData{&func, nullptr, "scan_source"};
+                self.scan_source(
+                    *static_cast<const yaral_block_source *>(source.value),
+                    &scan_callback,
                     static_cast<void *>(&cbData),
-                    flags);
+                    flags,
+                    scan);
                 if (cbData.pending)
                     std::rethrow_exception(cbData.pending);
+                return scan_report(lua);
             },
             "load_rules_file",
             &yara::Yara::load_rules_file,
@@ -373,89 +1269,85 @@ namespace yara::extend
             [](yara::Yara &self,
                const std::string &path,
                sol::function func,
-               yara::type::Flags flags)
+               yara::type::Flags flags,
+               sol::optional<sol::table> options,
+               sol::this_state state) -> sol::object
             {
-                if (!func.valid())
+                sol::state_view lua(state);
+                const yara::type::ScanOptions scan = scan_options(options);
+                if (!func.valid() && !scan.emitter)
                 {
-                    return;
+                    return sol::make_object(lua, sol::lua_nil);
                 }
-                struct LuaScanData
-                {
-                    sol::function *func;
-                    std::exception_ptr pending;
-                };
-                LuaScanData cbData{&func, nullptr};
-                self.scan_file(
-                    path,
-                    +[](YR_SCAN_CONTEXT *context,
-                        int message,
-                        void *message_data,
-                        void *user_data) -> int
-                    {
-                        auto *d = static_cast<LuaScanData *>(user_data);
-                        if (!d->func || !d->func->valid())
-                            return CALLBACK_CONTINUE;
-                        try
-                        {
-                            sol::protected_function_result result;
-                            switch (message)
-                            {
-                            case CALLBACK_MSG_RULE_NOT_MATCHING:
-                            case CALLBACK_MSG_RULE_MATCHING:
-                            {
-                                const YR_RULE *rule =
-                                    reinterpret_cast<YR_RULE *>(message_data);
-                                result = (*d->func)(message, rule);
-                                break;
-                            }
-                            case CALLBACK_MSG_SCAN_FINISHED:
-                                result = (*d->func)(message, sol::lua_nil);
-                                break;
-                            case CALLBACK_MSG_TOO_MANY_MATCHES:
-                            {
-                                const YR_STRING *string =
-                                    reinterpret_cast<YR_STRING *>(message_data);
-                                result = (*d->func)(message, string);
-                                break;
-                            }
-                            case CALLBACK_MSG_CONSOLE_LOG:
-                            {
-                                const char *log =
-                                    reinterpret_cast<const char *>(message_data);
-                                result = (*d->func)(message, log);
-                                break;
-                            }
-                            case CALLBACK_MSG_IMPORT_MODULE:
-                            {
-                                const YR_MODULE_IMPORT *module_import =
-                                    reinterpret_cast<YR_MODULE_IMPORT *>(
-                                        message_data);
-                                result = (*d->func)(message, module_import);
-                                break;
-                            }
-                            default:
-                                result = (*d->func)(message);
-                                break;
-                            }
-                            if (!result.valid())
-                            {
-                                sol::error err = result;
-                                throw lua::exception::Runtime(fmt::format(
-                                    "Lua callback error in scan_file: {}",
-                                    err.what()));
-                            }
-                            return static_cast<int>(result);
-                        }
-                        catch (...)
-                        {
-                            d->pending = std::current_exception();
-                            return CALLBACK_ABORT;
-                        }
-                    },
-                    static_cast<void *>(&cbData),
-                    flags);
+                LuaScanData cbData{&func, nullptr, "scan_file"};
+                self.scan_file(path,
+                               &scan_callback,
+                               static_cast<void *>(&cbData),
+                               flags,
+                               scan);
                 if (cbData.pending)
                     std::rethrow_exception(cbData.pending);
+                return scan_report(lua);
+            },
+            "scan_files",
+            [](yara::Yara &self,
+               const std::vector<std::string> &paths,
+               yara::type::Flags flags,
+               sol::optional<sol::table> options,
+               sol::this_state state)
+            {
+                sol::state_view lua(state);
+                auto results = self.scan_files(
+                    paths, flags, scan_options(options), bulk_options(options));
+
+                sol::table table = lua.create_table(results.size(), 0);
+                for (auto &result : results)
+                {
+                    table.add(scan_result(lua, std::move(result)));
+                }
+                return table;
+            },
+            "scan_archive",
+            [](yara::Yara &self,
+               const std::string &path,
+               yara::type::Flags flags,
+               sol::optional<sol::table> options,
+               sol::this_state state)
+            {
+                sol::state_view lua(state);
+                auto results = self.scan_archive(path,
+                                                 flags,
+                                                 scan_options(options),
+                                                 archive_limits(options));
+
+                sol::table table = lua.create_table(results.size(), 0);
+                for (auto &result : results)
+                {
+                    table.add(scan_result(lua, std::move(result)));
+                }
+                return table;
+            },
+            "scan_archive_bytes",
+            [](yara::Yara &self,
+               const std::string &buffer,
+               const std::string &name,
+               yara::type::Flags flags,
+               sol::optional<sol::table> options,
+               sol::this_state state)
+            {
+                sol::state_view lua(state);
+                auto results = self.scan_archive_bytes(buffer,
+                                                       name,
+                                                       flags,
+                                                       scan_options(options),
+                                                       archive_limits(options));
+
+                sol::table table = lua.create_table(results.size(), 0);
+                for (auto &result : results)
+                {
+                    table.add(scan_result(lua, std::move(result)));
+                }
+                return table;
             },
             "matches_foreach",
             [](yara::Yara &self,
@@ -491,6 +1383,56 @@ namespace yara::extend
             &yara::Yara::define_string_variable,
             "define_float_variable",
             &yara::Yara::define_float_variable,
+            "module_deny",
+            [](yara::Yara &self,
+               const std::string &scan_class,
+               const std::string &module)
+            { self.modules().deny(scan_class, module); },
+            "module_allow",
+            [](yara::Yara &self,
+               const std::string &scan_class,
+               const std::string &module)
+            { self.modules().allow(scan_class, module); },
+            "module_data",
+            [](yara::Yara &self, const std::string &module, sol::object data)
+            { self.modules().set_data(module, module_data(data)); },
+            "module_stats",
+            [](yara::Yara &self, sol::this_state state)
+            {
+                sol::state_view lua(state);
+                sol::table stats = lua.create_table();
+                for (const auto &[name, module] : self.modules().stats())
+                {
+                    stats[name] = lua.create_table_with(
+                        "imports", module.imports,
+                        "denied", module.denied,
+                        "supplied", module.supplied,
+                        "load_ns", module.load_ns,
+                        "denied_load_ns", module.denied_load_ns);
+                }
+                return stats;
+            },
+            "scan_stats",
+            [](yara::Yara &self, sol::this_state state)
+            {
+                sol::state_view lua(state);
+                return latency_report(lua, self.scan_stats());
+            },
+            "scan_stats_reset",
+            &yara::Yara::scan_stats_reset,
+            "publish_rules",
+            &yara::Yara::publish_rules,
+            "attach_rules",
+            [](yara::Yara &self,
+               const std::string &name,
+               sol::optional<uint64_t> version)
+            { self.attach_rules(name, version.value_or(0)); },
+            "share_rules",
+            [](yara::Yara &self,
+               const std::string &name,
+               uint64_t version,
+               const sol::table &sources)
+            { self.share_rules(name, version, rule_sources(sources)); },
             "set_compiler_callback",
             [](yara::Yara &self, sol::function func)
             {
@@ -546,7 +1488,12 @@ namespace yara::extend
         Yara::bind_meta();
         Yara::bind_rule();
         Yara::bind_stream();
+        Yara::bind_module_data();
+        Yara::bind_registry();
+        Yara::bind_emitter();
         Yara::bind_yara();
+        Yara::bind_scheduler();
+        Yara::bind_ingest();
         Yara::bind_flags();
     }
 } // namespace yara::Yara::extend
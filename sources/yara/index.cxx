@@ -0,0 +1,38 @@
+#include <fmt/core.h>
+#include <yara/index.hxx>
+
+namespace yara
+{
+    RuleIndex::RuleIndex(YR_RULES *p_rules)
+    {
+        if (p_rules == nullptr)
+            return;
+
+        YR_RULE *rule = nullptr;
+        yr_rules_foreach(p_rules, rule)
+        {
+            maps_[yara::type::Identifier][rule->identifier].push_back(rule);
+            maps_[yara::type::Identifier]
+                 [fmt::format("{}:{}", rule->ns->name, rule->identifier)]
+                     .push_back(rule);
+            maps_[yara::type::Namespace][rule->ns->name].push_back(rule);
+
+            const char *tag = nullptr;
+            yr_rule_tags_foreach(rule, tag)
+            {
+                maps_[yara::type::Tag][tag].push_back(rule);
+            }
+        }
+    }
+
+    const std::vector<YR_RULE *> &
+    RuleIndex::find(yara::type::RuleKey p_key, const std::string &p_name) const
+    {
+        static const std::vector<YR_RULE *> none;
+        if (p_key >= maps_.size())
+            return none;
+
+        const auto it = maps_[p_key].find(p_name);
+        return it != maps_[p_key].end() ? it->second : none;
+    }
+} // namespace yara
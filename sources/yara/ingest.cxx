@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <chrono>
+#include <fmt/core.h>
+#include <yara/emitter.hxx>
+#include <yara/ingest.hxx>
+#include <yara/yara.hxx>
+
+namespace yara
+{
+    namespace
+    {
+        /* empty polls spent spinning, then yielding, before sleeping */
+        constexpr unsigned SPIN = 64;
+        constexpr unsigned YIELD = 128;
+        constexpr std::chrono::microseconds MAX_SLEEP(1000);
+
+        void backoff(unsigned p_idle)
+        {
+            if (p_idle < SPIN)
+                return;
+            if (p_idle < YIELD)
+            {
+                std::this_thread::yield();
+                return;
+            }
+
+            // 10us doubling up to the cap, an idle ring wakes ~1000/s
+            const unsigned shift = std::min(p_idle - YIELD, 7u);
+            std::this_thread::sleep_for(
+                std::min(std::chrono::microseconds(10 << shift), MAX_SLEEP));
+        }
+
+        /* the worker emits with the slot error and path, not the scan */
+        yara::type::ScanOptions
+        without_emitter(const yara::type::ScanOptions &p_scan)
+        {
+            yara::type::ScanOptions options = p_scan;
+            options.emitter.reset();
+            return options;
+        }
+    } // namespace
+
+    Ingest::Ingest(const yara::Yara &p_yara,
+                   const std::string &p_name,
+                   yara::type::Flags p_flags,
+                   const IngestOptions &p_options,
+                   const yara::type::ScanOptions &p_scan)
+        : yara_(p_yara), flags_(p_flags), options_(without_emitter(p_scan)),
+          emitter_(p_scan.emitter),
+          ring_(p_options.create
+                    ? yara::Ring::create(
+                          p_name, p_options.slots, p_options.slot_size)
+                    : yara::Ring::open(p_name)),
+          stopping_(false), scanned_(0), failed_(0), matched_(0)
+    {
+        const size_t threads = std::max<size_t>(p_options.threads, 1);
+        workers_.reserve(threads);
+        for (size_t i = 0; i < threads; ++i)
+        {
+            workers_.emplace_back(&Ingest::work, this);
+        }
+    }
+
+    Ingest::~Ingest()
+    {
+        Ingest::stop();
+    }
+
+    const yara::Ring &Ingest::ring() const
+    {
+        return *ring_;
+    }
+
+    IngestStats Ingest::stats() const
+    {
+        IngestStats stats;
+        stats.scanned = scanned_.load();
+        stats.failed = failed_.load();
+        stats.matched = matched_.load();
+        stats.service = service_.report();
+        return stats;
+    }
+
+    void Ingest::stop()
+    {
+        stopping_.store(true);
+        for (auto &worker : workers_)
+        {
+            if (worker.joinable())
+                worker.join();
+        }
+    }
+
+    void Ingest::work()
+    {
+        unsigned idle = 0;
+        while (!stopping_.load(std::memory_order_relaxed))
+        {
+            const std::optional<uint32_t> slot = ring_->take();
+            if (!slot)
+            {
+                backoff(idle++);
+                continue;
+            }
+
+            idle = 0;
+            Ingest::scan(*slot);
+        }
+    }
+
+    void Ingest::scan(uint32_t p_slot)
+    {
+        yara::type::ScanResult result;
+        result.detailed = emitter_ != nullptr;
+        if (result.detailed)
+            result.path =
+                fmt::format("{}#{}", ring_->name(), ring_->id(p_slot));
+
+        const auto started = std::chrono::steady_clock::now();
+        try
+        {
+            yara_.scan_mem(ring_->data(p_slot),
+                           ring_->size(p_slot),
+                           &yara::Yara::collect,
+                           &result,
+                           flags_,
+                           options_);
+            result.exit = yara::Yara::last_exit();
+            result.digests = yara::Yara::last_digests();
+        }
+        catch (const std::exception &e)
+        {
+            result.error = e.what();
+        }
+        service_.record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - started)
+                .count()));
+
+        ++scanned_;
+        if (!result.error.empty())
+            ++failed_;
+        else if (!result.matches.empty())
+            ++matched_;
+
+        // The slot belongs to the producer again once complete returns
+        if (emitter_)
+            emitter_->emit(result);
+        ring_->complete(p_slot, result);
+    }
+} // namespace yara
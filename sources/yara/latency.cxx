@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <bit>
+#include <yara/latency.hxx>
+
+namespace yara
+{
+    Latency::Latency() : count_(0), max_(0), since_(std::chrono::steady_clock::now())
+    {
+        for (auto &bucket : buckets_)
+        {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void Latency::record(uint64_t p_ns)
+    {
+        // Bucket i holds samples in [2^(i-1), 2^i)
+        const size_t index =
+            std::min<size_t>(std::bit_width(p_ns), BUCKETS - 1);
+        buckets_[index].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+
+        uint64_t max = max_.load(std::memory_order_relaxed);
+        while (p_ns > max &&
+               !max_.compare_exchange_weak(max, p_ns, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    void Latency::reset()
+    {
+        for (auto &bucket : buckets_)
+        {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        count_.store(0, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+
+        const std::lock_guard<std::mutex> lock(since_mutex_);
+        since_ = std::chrono::steady_clock::now();
+    }
+
+    LatencyReport Latency::report() const
+    {
+        std::array<uint64_t, BUCKETS> buckets;
+        uint64_t total = 0;
+        for (size_t i = 0; i < BUCKETS; ++i)
+        {
+            buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+            total += buckets[i];
+        }
+
+        LatencyReport report;
+        report.count = total;
+        report.max_ns = max_.load(std::memory_order_relaxed);
+        {
+            const std::lock_guard<std::mutex> lock(since_mutex_);
+            report.seconds = std::chrono::duration<double>(
+                                 std::chrono::steady_clock::now() - since_)
+                                 .count();
+        }
+        if (report.seconds > 0)
+        {
+            report.per_second = static_cast<double>(total) / report.seconds;
+        }
+
+        const auto percentile = [&](double p_rank) -> uint64_t
+        {
+            if (total == 0)
+                return 0;
+
+            const auto target = static_cast<uint64_t>(p_rank * total);
+            uint64_t seen = 0;
+            for (size_t i = 0; i < BUCKETS; ++i)
+            {
+                seen += buckets[i];
+                if (seen > target)
+                    return std::min(i == 0 ? 0 : uint64_t(1) << i,
+                                    report.max_ns);
+            }
+            return report.max_ns;
+        };
+
+        report.p50_ns = percentile(0.50);
+        report.p90_ns = percentile(0.90);
+        report.p99_ns = percentile(0.99);
+        report.p999_ns = percentile(0.999);
+        return report;
+    }
+} // namespace yara
@@ -0,0 +1,467 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fmt/core.h>
+#include <iterator>
+#include <yara/linter.hxx>
+#include <yara/re.h>
+
+namespace yara
+{
+    namespace
+    {
+        /* bytes that are everywhere in binaries, poor atoms */
+        bool common_byte(uint8_t p_byte)
+        {
+            return p_byte == 0x00 || p_byte == 0x20 || p_byte == 0x90 ||
+                   p_byte == 0xCC || p_byte == 0xFF;
+        }
+
+        /* closes the current run of fixed bytes */
+        void end_run(std::vector<std::string> &p_runs, std::string &p_run)
+        {
+            if (!p_run.empty())
+                p_runs.push_back(std::move(p_run));
+            p_run.clear();
+        }
+
+        /* nodes that match a class of bytes, not a fixed one */
+        bool wildcard_node(const RE_NODE *p_node)
+        {
+            switch (p_node->type)
+            {
+            case RE_NODE_ANY:
+            case RE_NODE_MASKED_LITERAL:
+            case RE_NODE_CLASS:
+            case RE_NODE_WORD_CHAR:
+            case RE_NODE_NON_WORD_CHAR:
+            case RE_NODE_SPACE:
+            case RE_NODE_NON_SPACE:
+            case RE_NODE_DIGIT:
+            case RE_NODE_NON_DIGIT:
+            case RE_NODE_NOT_LITERAL:
+            case RE_NODE_MASKED_NOT_LITERAL:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        void add_issue(std::vector<std::string> &p_issues,
+                       std::string p_issue)
+        {
+            if (std::find(p_issues.begin(), p_issues.end(), p_issue) ==
+                p_issues.end())
+                p_issues.push_back(std::move(p_issue));
+        }
+    } // namespace
+
+    Linter::Linter(const LintOptions &p_options) : options_(p_options)
+    {
+    }
+
+    int Linter::quality(std::string_view p_bytes, bool p_nocase)
+    {
+        // Up to 25 points per byte of a YR_MAX_ATOM_LENGTH window, less
+        // for common and case folded bytes, halved for a repeated byte
+        const size_t window =
+            std::min<size_t>(p_bytes.size(), YR_MAX_ATOM_LENGTH);
+        if (window == 0)
+            return 0;
+
+        int best = 0;
+        for (size_t at = 0; at + window <= p_bytes.size(); ++at)
+        {
+            const std::string_view atom = p_bytes.substr(at, window);
+            int score = 0;
+            for (const char c : atom)
+            {
+                const auto byte = static_cast<uint8_t>(c);
+                if (common_byte(byte))
+                    score += 5;
+                else if (std::isalnum(byte))
+                    score += p_nocase ? 12 : 18;
+                else
+                    score += 25;
+            }
+            if (window > 1 &&
+                std::all_of(atom.begin(),
+                            atom.end(),
+                            [&atom](char c) { return c == atom[0]; }))
+                score /= 2;
+            best = std::max(best, score);
+        }
+        return best;
+    }
+
+    void Linter::diagnostic(const yara::type::CompileEvent &p_event)
+    {
+        if (p_event.type != yara::type::Warning &&
+            p_event.type != yara::type::Error)
+            return;
+
+        LintDiagnostic diagnostic;
+        diagnostic.error = p_event.type == yara::type::Error;
+        diagnostic.file = p_event.file;
+        diagnostic.line = p_event.line;
+        diagnostic.rule = p_event.rule;
+        diagnostic.message = p_event.message;
+
+        // libyara says: string "$a" may slow down scanning
+        const size_t open = p_event.message.find("string \"");
+        if (open != std::string::npos)
+        {
+            const size_t begin = open + 8;
+            const size_t close = p_event.message.find('"', begin);
+            if (close != std::string::npos)
+                diagnostic.string =
+                    p_event.message.substr(begin, close - begin);
+        }
+        diagnostic.slow =
+            p_event.message.find("slow down scanning") != std::string::npos ||
+            p_event.message.find("slowing down scanning") != std::string::npos;
+
+        diagnostics_.push_back(std::move(diagnostic));
+    }
+
+    void Linter::attach(YR_COMPILER *p_compiler)
+    {
+        yr_compiler_set_re_ast_callback(p_compiler, &Linter::parsed, this);
+    }
+
+    void Linter::parsed(const YR_RULE *p_rule,
+                        const char *p_identifier,
+                        const RE_AST *p_ast,
+                        void *p_user_data)
+    {
+        if (p_rule == nullptr || p_rule->identifier == nullptr ||
+            p_ast == nullptr)
+            return;
+
+        auto *linter = static_cast<Linter *>(p_user_data);
+        const char *ns = p_rule->ns != nullptr && p_rule->ns->name != nullptr
+                             ? p_rule->ns->name
+                             : "";
+        Shape &shape =
+            linter->shapes_[fmt::format("{}:{}", ns, p_rule->identifier)]
+                .emplace_back();
+        shape.identifier = p_identifier ? p_identifier : "";
+
+        // The tree belongs to the compiler, keep only what lint reads
+        std::string run;
+        if (p_ast->root_node != nullptr)
+            Linter::walk(p_ast->root_node, shape, run);
+        end_run(shape.runs, run);
+    }
+
+    void Linter::walk(const RE_NODE *p_node, Shape &p_shape, std::string &p_run)
+    {
+        switch (p_node->type)
+        {
+        case RE_NODE_LITERAL:
+            p_run.push_back(static_cast<char>(p_node->value));
+            return;
+        case RE_NODE_EMPTY:
+            return;
+        case RE_NODE_CONCAT:
+            for (const RE_NODE *child = p_node->children_head;
+                 child != nullptr;
+                 child = child->next_sibling)
+            {
+                Linter::walk(child, p_shape, p_run);
+            }
+            return;
+        case RE_NODE_ALT:
+            // Each alternative may supply the atom on its own
+            end_run(p_shape.runs, p_run);
+            for (const RE_NODE *child = p_node->children_head;
+                 child != nullptr;
+                 child = child->next_sibling)
+            {
+                Linter::walk(child, p_shape, p_run);
+                end_run(p_shape.runs, p_run);
+            }
+            return;
+        case RE_NODE_RANGE_ANY:
+            // Hex jumps and .{n,m}
+            end_run(p_shape.runs, p_run);
+            p_shape.repeats.push_back(
+                {'{', true, p_node->start, p_node->end});
+            return;
+        case RE_NODE_STAR:
+        case RE_NODE_PLUS:
+        case RE_NODE_RANGE:
+        {
+            end_run(p_shape.runs, p_run);
+            const RE_NODE *child = p_node->children_head;
+            Repeat repeat{'{', false, 0, RE_MAX_RANGE};
+            if (p_node->type == RE_NODE_RANGE)
+            {
+                repeat.start = p_node->start;
+                repeat.end = p_node->end;
+            }
+            else
+            {
+                repeat.op = p_node->type == RE_NODE_STAR ? '*' : '+';
+                repeat.start = p_node->type == RE_NODE_STAR ? 0 : 1;
+            }
+            repeat.wildcard = child != nullptr && wildcard_node(child);
+            p_shape.repeats.push_back(repeat);
+
+            // A repeat that must match once holds atoms of its own
+            if (child != nullptr && repeat.start > 0)
+            {
+                Linter::walk(child, p_shape, p_run);
+                end_run(p_shape.runs, p_run);
+            }
+            return;
+        }
+        default:
+            // Wildcards, classes, masks, negations and anchors
+            end_run(p_shape.runs, p_run);
+            return;
+        }
+    }
+
+    LintString Linter::lint_string(const YR_STRING *p_string,
+                                   const Shape *p_shape) const
+    {
+        LintString string;
+        string.identifier = p_string->identifier ? p_string->identifier : "";
+
+        // Hex and regex strings keep bytes only when they are literals
+        const std::string_view text(
+            reinterpret_cast<const char *>(p_string->string),
+            p_string->string ? std::max(p_string->length, 0) : 0);
+        const bool nocase = p_string->flags & STRING_FLAGS_NO_CASE;
+        const bool hex = p_string->flags & STRING_FLAGS_HEXADECIMAL;
+
+        if (p_shape == nullptr ||
+            !(p_string->flags &
+              (STRING_FLAGS_HEXADECIMAL | STRING_FLAGS_REGEXP)))
+        {
+            if (hex)
+                string.kind = "hex";
+            else if (p_string->flags & STRING_FLAGS_REGEXP)
+                string.kind = "regex";
+            else
+                string.kind = "text";
+            string.atom = text.size();
+            string.quality = Linter::quality(text, nocase);
+        }
+        else
+        {
+            string.kind = hex ? "hex" : "regex";
+            for (const auto &run : p_shape->runs)
+            {
+                string.atom = std::max(string.atom, run.size());
+                string.quality =
+                    std::max(string.quality, Linter::quality(run, nocase));
+            }
+
+            for (const Repeat &repeat : p_shape->repeats)
+            {
+                const bool unbounded = repeat.end >= RE_MAX_RANGE;
+                const bool wide =
+                    !unbounded && repeat.end > repeat.start &&
+                    static_cast<size_t>(repeat.end - repeat.start) >
+                        options_.max_jump;
+                if (repeat.op != '{')
+                {
+                    if (repeat.wildcard)
+                        add_issue(string.issues,
+                                  fmt::format("unbounded wildcard .{}",
+                                              repeat.op));
+                }
+                else if (hex && repeat.wildcard)
+                {
+                    if (unbounded)
+                        add_issue(string.issues,
+                                  fmt::format("unbounded jump [{}-]",
+                                              repeat.start));
+                    else if (wide)
+                        add_issue(string.issues,
+                                  fmt::format("wide jump [{}-{}]",
+                                              repeat.start,
+                                              repeat.end));
+                }
+                else if (unbounded)
+                {
+                    add_issue(string.issues,
+                              fmt::format("unbounded repeat {{{},}}",
+                                          repeat.start));
+                }
+                else if (wide && repeat.wildcard)
+                {
+                    add_issue(string.issues,
+                              fmt::format("wide wildcard repeat {{{},{}}}",
+                                          repeat.start,
+                                          repeat.end));
+                }
+            }
+        }
+
+        if (string.atom < 2)
+            add_issue(string.issues,
+                      fmt::format("short atom of {} byte(s)", string.atom));
+        if (string.quality < options_.min_quality)
+            add_issue(string.issues,
+                      fmt::format("weak atom, quality {}", string.quality));
+        if (p_string->flags & STRING_FLAGS_XOR)
+            add_issue(string.issues, "xor searches up to 256 atom variants");
+        if (p_string->flags & STRING_FLAGS_CHAIN_PART)
+            add_issue(string.issues,
+                      fmt::format("split at a jump of {} to {} bytes",
+                                  p_string->chain_gap_min,
+                                  p_string->chain_gap_max));
+        return string;
+    }
+
+    LintReport Linter::report(YR_RULES *p_rules)
+    {
+        LintReport report;
+        report.compiled = p_rules != nullptr;
+        report.diagnostics = diagnostics_;
+        if (p_rules == nullptr)
+            return report;
+
+        static const std::vector<Shape> none;
+        YR_RULE *rule;
+        yr_rules_foreach(p_rules, rule)
+        {
+            LintRule &lint = report.rules.emplace_back();
+            lint.identifier = rule->identifier;
+            lint.ns = rule->ns->name;
+            lint.atoms = rule->num_atoms;
+            lint.cost = static_cast<uint64_t>(std::max(rule->num_atoms, 0));
+
+            const auto found =
+                shapes_.find(fmt::format("{}:{}", lint.ns, lint.identifier));
+            const std::vector<Shape> &shapes =
+                found != shapes_.end() ? found->second : none;
+            size_t next = 0;
+
+            YR_STRING *string;
+            yr_rule_strings_foreach(rule, string)
+            {
+                // Later parts of a chained hex string repeat its name
+                if (string->chained_to != nullptr)
+                    continue;
+
+                // Shapes come in declaration order, anonymous ones too
+                const Shape *shape = nullptr;
+                if (string->flags &
+                    (STRING_FLAGS_HEXADECIMAL | STRING_FLAGS_REGEXP))
+                {
+                    const std::string_view identifier(
+                        string->identifier ? string->identifier : "");
+                    for (size_t i = next; i < shapes.size(); ++i)
+                    {
+                        if (shapes[i].identifier != identifier)
+                            continue;
+                        shape = &shapes[i];
+                        next = i + 1;
+                        break;
+                    }
+                }
+
+                LintString &checked = lint.strings.emplace_back(
+                    Linter::lint_string(string, shape));
+                lint.cost += static_cast<uint64_t>(
+                    100 - std::min(checked.quality, 100));
+                lint.flagged = lint.flagged || !checked.issues.empty();
+            }
+
+            for (const auto &diagnostic : diagnostics_)
+            {
+                if (!diagnostic.slow || diagnostic.rule != lint.identifier)
+                    continue;
+                add_issue(lint.issues,
+                          fmt::format("libyara: string {} may slow down "
+                                      "scanning",
+                                      diagnostic.string));
+                lint.cost += 100;
+            }
+
+            if (options_.max_atoms != 0 &&
+                static_cast<size_t>(std::max(lint.atoms, 0)) >
+                    options_.max_atoms)
+                add_issue(lint.issues,
+                          fmt::format("{} atoms, limit is {}",
+                                      lint.atoms,
+                                      options_.max_atoms));
+
+            lint.flagged = lint.flagged || !lint.issues.empty();
+            if (lint.flagged)
+                ++report.flagged;
+        }
+        return report;
+    }
+
+    std::string Linter::dump(const LintReport &p_report)
+    {
+        std::vector<const LintRule *> rules;
+        rules.reserve(p_report.rules.size());
+        for (const auto &rule : p_report.rules)
+        {
+            rules.push_back(&rule);
+        }
+        std::stable_sort(rules.begin(),
+                         rules.end(),
+                         [](const LintRule *a, const LintRule *b)
+                         { return a->cost > b->cost; });
+
+        std::string out;
+        auto it = std::back_inserter(out);
+        for (const LintRule *rule : rules)
+        {
+            fmt::format_to(it,
+                           "{:>8} {}:{} atoms={}{}\n",
+                           rule->cost,
+                           rule->ns,
+                           rule->identifier,
+                           rule->atoms,
+                           rule->flagged ? " FLAGGED" : "");
+            for (const auto &issue : rule->issues)
+            {
+                fmt::format_to(it, "         {}\n", issue);
+            }
+            for (const auto &string : rule->strings)
+            {
+                if (string.issues.empty())
+                    continue;
+                fmt::format_to(it,
+                               "         {} {} atom={} quality={}:",
+                               string.identifier,
+                               string.kind,
+                               string.atom,
+                               string.quality);
+                for (size_t i = 0; i < string.issues.size(); ++i)
+                {
+                    fmt::format_to(
+                        it, "{} {}", i == 0 ? "" : ",", string.issues[i]);
+                }
+                out.push_back('\n');
+            }
+        }
+
+        for (const auto &diagnostic : p_report.diagnostics)
+        {
+            fmt::format_to(it,
+                           "{} {}:{}: {}{}\n",
+                           diagnostic.error ? "error" : "warning",
+                           diagnostic.file,
+                           diagnostic.line,
+                           diagnostic.rule.empty()
+                               ? std::string()
+                               : fmt::format("{}: ", diagnostic.rule),
+                           diagnostic.message);
+        }
+        fmt::format_to(it,
+                       "{} rule(s), {} flagged{}\n",
+                       p_report.rules.size(),
+                       p_report.flagged,
+                       p_report.compiled ? "" : ", compile failed");
+        return out;
+    }
+} // namespace yara
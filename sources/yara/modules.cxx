@@ -0,0 +1,78 @@
+#include <yara/modules.hxx>
+
+namespace yara
+{
+    void Modules::deny(const std::string &p_class, const std::string &p_module)
+    {
+        const std::unique_lock<std::shared_mutex> lock(policy_mutex_);
+        denied_[p_class].insert(p_module);
+    }
+
+    void Modules::allow(const std::string &p_class,
+                        const std::string &p_module)
+    {
+        const std::unique_lock<std::shared_mutex> lock(policy_mutex_);
+        const auto it = denied_.find(p_class);
+        if (it != denied_.end())
+        {
+            it->second.erase(p_module);
+        }
+    }
+
+    void Modules::set_data(const std::string &p_module,
+                           yara::type::ModuleData p_data)
+    {
+        const std::unique_lock<std::shared_mutex> lock(policy_mutex_);
+        if (!p_data)
+        {
+            data_.erase(p_module);
+            return;
+        }
+        data_[p_module] = std::move(p_data);
+    }
+
+    const bool Modules::denied(const std::string &p_class,
+                               const char *p_module) const
+    {
+        const std::shared_lock<std::shared_mutex> lock(policy_mutex_);
+        const auto it = denied_.find(p_class);
+        return it != denied_.end() && it->second.count(p_module) > 0;
+    }
+
+    yara::type::ModuleData Modules::data(const char *p_module) const
+    {
+        const std::shared_lock<std::shared_mutex> lock(policy_mutex_);
+        const auto it = data_.find(p_module);
+        return it != data_.end() ? it->second : nullptr;
+    }
+
+    void Modules::record(const char *p_module,
+                         bool p_denied,
+                         bool p_supplied,
+                         uint64_t p_load_ns) const
+    {
+        const std::lock_guard<std::mutex> lock(stats_mutex_);
+        yara::type::ModuleStats &stats = stats_[p_module];
+        ++stats.imports;
+        if (p_denied)
+        {
+            ++stats.denied;
+            stats.denied_load_ns += p_load_ns;
+        }
+        else
+        {
+            stats.load_ns += p_load_ns;
+        }
+        if (p_supplied)
+        {
+            ++stats.supplied;
+        }
+    }
+
+    std::unordered_map<std::string, yara::type::ModuleStats> Modules::stats()
+        const
+    {
+        const std::lock_guard<std::mutex> lock(stats_mutex_);
+        return stats_;
+    }
+} // namespace yara
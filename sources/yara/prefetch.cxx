@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <memory>
+#include <optional>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <yara.h>
+#include <yara/prefetch.hxx>
+
+#ifdef YARAL_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+namespace yara
+{
+    Prefetch::Prefetch(const std::vector<std::string> &p_paths,
+                       size_t p_depth,
+                       size_t p_max_size,
+                       yara::Buffers &p_buffers,
+                       yara::Queue<Loaded> &p_out)
+        : paths_(p_paths), depth_(std::max<size_t>(p_depth, 1)),
+          max_size_(p_max_size), buffers_(p_buffers), out_(p_out),
+          uring_(false), next_(0)
+    {
+        threads_.emplace_back(&Prefetch::run, this);
+    }
+
+    Prefetch::~Prefetch()
+    {
+        for (auto &thread : threads_)
+        {
+            if (thread.joinable())
+                thread.join();
+        }
+    }
+
+    const bool Prefetch::uring() const
+    {
+        return uring_.load();
+    }
+
+    void Prefetch::run()
+    {
+        if (!Prefetch::run_uring())
+        {
+            Prefetch::run_pread();
+        }
+        out_.close();
+    }
+
+    const bool Prefetch::emit(Loaded &&p_loaded)
+    {
+        if (out_.push(std::move(p_loaded)))
+            return true;
+
+        // Consumers closed the queue, stop handing out new files
+        next_.store(paths_.size());
+        return false;
+    }
+
+    const bool Prefetch::open(size_t p_index, int &p_fd, size_t &p_size)
+    {
+        p_fd = ::open(paths_[p_index].c_str(), O_RDONLY | O_CLOEXEC);
+        if (p_fd == -1)
+        {
+            Loaded loaded;
+            loaded.index = p_index;
+            loaded.error = ERROR_COULD_NOT_OPEN_FILE;
+            (void)Prefetch::emit(std::move(loaded));
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(p_fd, &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            close(p_fd);
+            Loaded loaded;
+            loaded.index = p_index;
+            loaded.error = ERROR_COULD_NOT_OPEN_FILE;
+            (void)Prefetch::emit(std::move(loaded));
+            return false;
+        }
+
+        p_size = static_cast<size_t>(st.st_size);
+        if (p_size > max_size_ || p_size == 0)
+        {
+            close(p_fd);
+            Loaded loaded;
+            loaded.index = p_index;
+            loaded.oversized = p_size > max_size_;
+            (void)Prefetch::emit(std::move(loaded));
+            return false;
+        }
+        return true;
+    }
+
+    const bool Prefetch::run_uring()
+    {
+#ifdef YARAL_HAVE_LIBURING
+        struct io_uring ring;
+        if (io_uring_queue_init(static_cast<unsigned>(depth_), &ring, 0) < 0)
+        {
+            // Kernel without io_uring (or it is disabled), use pread
+            return false;
+        }
+        uring_.store(true);
+
+        struct Pending
+        {
+            size_t index;
+            int fd;
+            Buffer buffer;
+            size_t done;
+        };
+
+        const auto submit = [&ring](Pending *p_pending)
+        {
+            struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+            io_uring_prep_read(sqe,
+                               p_pending->fd,
+                               p_pending->buffer.data.get() + p_pending->done,
+                               p_pending->buffer.size - p_pending->done,
+                               p_pending->done);
+            io_uring_sqe_set_data(sqe, p_pending);
+        };
+
+        const size_t total = paths_.size();
+        size_t inflight = 0;
+        bool stopped = false;
+        /* opened file waiting for the byte budget */
+        std::unique_ptr<Pending> parked;
+
+        while (!stopped)
+        {
+            while (inflight < depth_ && (parked || next_.load() < total))
+            {
+                if (!parked)
+                {
+                    const size_t index = next_++;
+                    int fd = -1;
+                    size_t size = 0;
+                    if (!Prefetch::open(index, fd, size))
+                        continue;
+                    parked.reset(new Pending{index, fd, {}, 0});
+                    parked->buffer.size = size;
+                }
+
+                // Reads in flight hold budget only this thread frees by
+                // handing them over, wait for it only when there are none
+                std::optional<Buffer> buffer =
+                    buffers_.reserve(parked->buffer.size, inflight == 0);
+                if (!buffer)
+                {
+                    if (inflight > 0)
+                        break;
+                    close(parked->fd);
+                    parked.reset();
+                    stopped = true;
+                    break;
+                }
+
+                parked->buffer = std::move(*buffer);
+                submit(parked.release());
+                ++inflight;
+            }
+
+            if (inflight == 0)
+                break;
+
+            io_uring_submit(&ring);
+
+            struct io_uring_cqe *cqe = nullptr;
+            const int waited = io_uring_wait_cqe(&ring, &cqe);
+            if (waited == -EINTR)
+                continue;
+            if (waited < 0)
+                break;
+
+            do
+            {
+                std::unique_ptr<Pending> pending(
+                    static_cast<Pending *>(io_uring_cqe_get_data(cqe)));
+                const int res = cqe->res;
+                io_uring_cqe_seen(&ring, cqe);
+                --inflight;
+
+                if (res > 0)
+                    pending->done += static_cast<size_t>(res);
+
+                if (res == -EINTR || res == -EAGAIN ||
+                    (res > 0 && pending->done < pending->buffer.size))
+                {
+                    // Short read, ask for the rest
+                    submit(pending.release());
+                    ++inflight;
+                    continue;
+                }
+
+                close(pending->fd);
+                Loaded loaded;
+                loaded.index = pending->index;
+                loaded.error = res < 0 ? ERROR_COULD_NOT_MAP_FILE : 0;
+                loaded.buffer = std::move(pending->buffer);
+                loaded.buffer.size = pending->done;
+                if (!Prefetch::emit(std::move(loaded)))
+                    stopped = true;
+            } while (io_uring_peek_cqe(&ring, &cqe) == 0);
+        }
+
+        if (parked)
+            close(parked->fd);
+
+        // Consumers went away, reap what is still in flight
+        if (inflight > 0)
+            io_uring_submit(&ring);
+        while (inflight > 0)
+        {
+            struct io_uring_cqe *cqe = nullptr;
+            if (io_uring_wait_cqe(&ring, &cqe) < 0)
+                break;
+            std::unique_ptr<Pending> pending(
+                static_cast<Pending *>(io_uring_cqe_get_data(cqe)));
+            io_uring_cqe_seen(&ring, cqe);
+            close(pending->fd);
+            buffers_.release(std::move(pending->buffer));
+            --inflight;
+        }
+
+        io_uring_queue_exit(&ring);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void Prefetch::run_pread()
+    {
+        const size_t total = paths_.size();
+        const size_t workers = std::min(depth_, total);
+
+        const auto worker = [this, total]()
+        {
+            for (size_t index = next_++; index < total; index = next_++)
+            {
+                int fd = -1;
+                size_t size = 0;
+                if (!Prefetch::open(index, fd, size))
+                    continue;
+
+                std::optional<Buffer> buffer = buffers_.reserve(size, true);
+                if (!buffer)
+                {
+                    // The pool was closed, nobody scans what is read now
+                    close(fd);
+                    next_.store(total);
+                    return;
+                }
+
+                Loaded loaded;
+                loaded.index = index;
+                loaded.buffer = std::move(*buffer);
+
+                size_t done = 0;
+                while (done < size)
+                {
+                    const ssize_t got = pread(fd,
+                                              loaded.buffer.data.get() + done,
+                                              size - done,
+                                              static_cast<off_t>(done));
+                    if (got < 0 && errno == EINTR)
+                        continue;
+                    if (got < 0)
+                    {
+                        loaded.error = ERROR_COULD_NOT_MAP_FILE;
+                        break;
+                    }
+                    if (got == 0)
+                        break;
+                    done += static_cast<size_t>(got);
+                }
+                close(fd);
+
+                loaded.buffer.size = done;
+                if (!Prefetch::emit(std::move(loaded)))
+                    return;
+            }
+        };
+
+        std::vector<std::thread> pool;
+        pool.reserve(workers);
+        for (size_t i = 0; i < workers; ++i)
+        {
+            pool.emplace_back(worker);
+        }
+        for (auto &thread : pool)
+        {
+            thread.join();
+        }
+    }
+} // namespace yara
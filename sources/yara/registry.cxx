@@ -0,0 +1,186 @@
+#include <fmt/core.h>
+#include <yara/exception.hxx>
+#include <yara/registry.hxx>
+#include <yara/yara.hxx>
+
+namespace yara
+{
+    Registry &Registry::instance()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    Registry::~Registry()
+    {
+        if (!entries_.empty())
+        {
+            entries_.clear();
+            yara::Yara::lifecycle_release();
+        }
+    }
+
+    size_t Registry::footprint(const YR_RULES *p_rules)
+    {
+        if (IS_NULL(p_rules) || IS_NULL(p_rules->arena))
+            return 0;
+
+        size_t bytes = 0;
+        for (int i = 0; i < p_rules->arena->num_buffers; ++i)
+        {
+            bytes += p_rules->arena->buffers[i].size;
+        }
+        return bytes;
+    }
+
+    std::map<Registry::Key, Registry::Entry>::const_iterator
+    Registry::find_locked(const std::string &p_name, uint64_t p_version) const
+    {
+        if (p_version != 0)
+            return entries_.find({p_name, p_version});
+
+        // Keys are ordered by version, the last one under the name wins
+        auto it = entries_.upper_bound({p_name, UINT64_MAX});
+        if (it == entries_.begin())
+            return entries_.end();
+        --it;
+        return it->first.first == p_name ? it : entries_.end();
+    }
+
+    void Registry::publish(const std::string &p_name,
+                           uint64_t p_version,
+                           yara::type::Rules p_rules)
+    {
+        if (!p_rules || p_version == 0)
+        {
+            throw yara::exception::Registry(fmt::format(
+                "publish() failed: invalid rules or version for '{}'",
+                p_name));
+        }
+
+        const std::lock_guard<std::mutex> lock(mutex_);
+        const Key key{p_name, p_version};
+        if (entries_.count(key) != 0)
+        {
+            throw yara::exception::Registry(
+                fmt::format("publish() failed: '{}' version {} already "
+                            "published",
+                            p_name,
+                            p_version));
+        }
+
+        // The registry keeps libyara initialized while it holds rules
+        if (entries_.empty())
+            yara::Yara::lifecycle_acquire();
+
+        const size_t bytes = Registry::footprint(p_rules.get());
+        entries_.emplace(key, Entry{std::move(p_rules), bytes});
+    }
+
+    yara::type::Rules Registry::attach(const std::string &p_name,
+                                       uint64_t p_version) const
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        const auto it = Registry::find_locked(p_name, p_version);
+        if (it == entries_.end())
+        {
+            throw yara::exception::Registry(
+                fmt::format("attach() failed: '{}' version {} not published",
+                            p_name,
+                            p_version));
+        }
+        return it->second.rules;
+    }
+
+    yara::type::Rules
+    Registry::acquire(const std::string &p_name,
+                      uint64_t p_version,
+                      const std::function<yara::type::Rules()> &p_build)
+    {
+        const Key key{p_name, p_version};
+        std::promise<yara::type::Rules> promise;
+        std::shared_future<yara::type::Rules> waiting;
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            const auto it = entries_.find(key);
+            if (it != entries_.end())
+                return it->second.rules;
+
+            const auto pending = pending_.find(key);
+            if (pending != pending_.end())
+                waiting = pending->second;
+            else
+                pending_.emplace(key, promise.get_future().share());
+        }
+
+        // Somebody else is compiling it, rethrows if they failed
+        if (waiting.valid())
+            return waiting.get();
+
+        try
+        {
+            yara::type::Rules rules = p_build();
+            Registry::publish(p_name, p_version, rules);
+            promise.set_value(rules);
+
+            const std::lock_guard<std::mutex> lock(mutex_);
+            pending_.erase(key);
+            return rules;
+        }
+        catch (...)
+        {
+            promise.set_exception(std::current_exception());
+            const std::lock_guard<std::mutex> lock(mutex_);
+            pending_.erase(key);
+            throw;
+        }
+    }
+
+    const bool Registry::unpublish(const std::string &p_name,
+                                   uint64_t p_version)
+    {
+        yara::type::Rules released;
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            const auto it = Registry::find_locked(p_name, p_version);
+            if (it == entries_.end())
+                return false;
+
+            released = it->second.rules;
+            entries_.erase(it);
+            if (!entries_.empty())
+                return true;
+        }
+
+        // Drop the rules before libyara can be finalized
+        released.reset();
+        yara::Yara::lifecycle_release();
+        return true;
+    }
+
+    std::vector<yara::type::RegistryEntry> Registry::entries() const
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<yara::type::RegistryEntry> entries;
+        entries.reserve(entries_.size());
+        for (const auto &[key, entry] : entries_)
+        {
+            entries.push_back({key.first,
+                               key.second,
+                               entry.bytes,
+                               entry.rules.use_count() - 1});
+        }
+        return entries;
+    }
+
+    size_t Registry::bytes() const
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        size_t bytes = 0;
+        for (const auto &[key, entry] : entries_)
+        {
+            bytes += entry.bytes;
+        }
+        return bytes;
+    }
+} // namespace yara
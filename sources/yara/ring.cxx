@@ -0,0 +1,416 @@
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <yara/exception.hxx>
+#include <yara/ring.hxx>
+
+namespace yara
+{
+    namespace
+    {
+        constexpr size_t ALIGN = 64;
+        constexpr size_t PAGE = 4096;
+
+        size_t align(size_t p_size, size_t p_to)
+        {
+            return (p_size + p_to - 1) & ~(p_to - 1);
+        }
+
+        std::string segment(const std::string &p_name)
+        {
+            // shm_open wants a single leading slash and no other
+            return p_name.starts_with('/') ? p_name : "/" + p_name;
+        }
+    } // namespace
+
+    Ring::Ring(const std::string &p_name,
+               bool p_owner,
+               uint8_t *p_base,
+               size_t p_length)
+        : name_(p_name), owner_(p_owner), base_(p_base), length_(p_length),
+          header_(reinterpret_cast<Header *>(p_base)), count_(header_->slots),
+          slot_size_(static_cast<size_t>(header_->slot_size))
+    {
+        size_t offsets[5];
+        (void)Ring::layout(count_, slot_size_, offsets);
+        for (size_t queue = 0; queue < 3; ++queue)
+        {
+            cells_[queue] = reinterpret_cast<Cell *>(base_ + offsets[queue]);
+        }
+        slots_ = reinterpret_cast<Slot *>(base_ + offsets[3]);
+        data_ = base_ + offsets[4];
+    }
+
+    Ring::~Ring()
+    {
+        munmap(base_, length_);
+        if (owner_)
+            shm_unlink(name_.c_str());
+    }
+
+    size_t Ring::layout(uint32_t p_slots, size_t p_slot_size, size_t *p_offsets)
+    {
+        size_t offset = align(sizeof(Header), ALIGN);
+        for (size_t queue = 0; queue < 3; ++queue)
+        {
+            p_offsets[queue] = offset;
+            offset = align(offset + sizeof(Cell) * p_slots, ALIGN);
+        }
+        p_offsets[3] = offset;
+        offset = align(offset + sizeof(Slot) * p_slots, PAGE);
+        p_offsets[4] = offset;
+        return offset + p_slot_size * p_slots;
+    }
+
+    std::unique_ptr<Ring>
+    Ring::create(const std::string &p_name, uint32_t p_slots, size_t p_slot_size)
+    {
+        if (p_slots == 0 || p_slot_size == 0)
+            throw exception::Ring("ring needs at least one non empty slot");
+
+        const uint32_t slots = std::bit_ceil(p_slots);
+        const size_t slot_size = align(p_slot_size, ALIGN);
+        size_t offsets[5];
+        const size_t length = Ring::layout(slots, slot_size, offsets);
+
+        const std::string name = segment(p_name);
+        shm_unlink(name.c_str());
+        const int fd =
+            shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd == -1)
+            throw exception::Ring(fmt::format(
+                "could not create ring '{}': {}", name, std::strerror(errno)));
+
+        if (ftruncate(fd, static_cast<off_t>(length)) != 0)
+        {
+            const int error = errno;
+            close(fd);
+            shm_unlink(name.c_str());
+            throw exception::Ring(fmt::format(
+                "could not size ring '{}': {}", name, std::strerror(error)));
+        }
+
+        void *base =
+            mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED)
+        {
+            shm_unlink(name.c_str());
+            throw exception::Ring(fmt::format(
+                "could not map ring '{}': {}", name, std::strerror(errno)));
+        }
+
+        // A fresh segment is zero filled, the atomics still have to be
+        // constructed before anyone looks at them
+        Header *header = new (base) Header{};
+        header->version = VERSION;
+        header->slots = slots;
+        header->verdict_size = VERDICT_SIZE;
+        header->slot_size = slot_size;
+        header->total_size = length;
+
+        uint8_t *bytes = static_cast<uint8_t *>(base);
+        for (size_t queue = 0; queue < 3; ++queue)
+        {
+            Cell *cells = reinterpret_cast<Cell *>(bytes + offsets[queue]);
+            for (uint32_t i = 0; i < slots; ++i)
+            {
+                new (&cells[i]) Cell{};
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        std::unique_ptr<Ring> ring(
+            new Ring(name, true, bytes, length));
+        for (uint32_t i = 0; i < slots; ++i)
+        {
+            (void)ring->push(FREE, i);
+        }
+
+        // Openers check the magic last, publish it once all of the above
+        // is visible
+        std::atomic_ref<uint32_t>(header->magic)
+            .store(MAGIC, std::memory_order_release);
+        return ring;
+    }
+
+    std::unique_ptr<Ring> Ring::open(const std::string &p_name)
+    {
+        const std::string name = segment(p_name);
+        const int fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+        if (fd == -1)
+            throw exception::Ring(fmt::format(
+                "could not open ring '{}': {}", name, std::strerror(errno)));
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 ||
+            static_cast<size_t>(st.st_size) < sizeof(Header))
+        {
+            close(fd);
+            throw exception::Ring(
+                fmt::format("ring '{}' is not initialized", name));
+        }
+
+        const size_t length = static_cast<size_t>(st.st_size);
+        void *base =
+            mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED)
+            throw exception::Ring(fmt::format(
+                "could not map ring '{}': {}", name, std::strerror(errno)));
+
+        Header *header = static_cast<Header *>(base);
+        const uint32_t magic = std::atomic_ref<uint32_t>(header->magic)
+                                   .load(std::memory_order_acquire);
+        // The layout is rebuilt from the header, check it really spans
+        // the segment before trusting it
+        const uint32_t slots = header->slots;
+        const uint64_t slot_size = header->slot_size;
+        size_t offsets[5];
+        if (magic != MAGIC || header->version != VERSION ||
+            header->verdict_size != VERDICT_SIZE ||
+            header->total_size != length || !std::has_single_bit(slots) ||
+            slot_size == 0 || slot_size > length / slots ||
+            Ring::layout(slots, static_cast<size_t>(slot_size), offsets) !=
+                length)
+        {
+            munmap(base, length);
+            throw exception::Ring(fmt::format(
+                "ring '{}' has an unknown layout or is not ready", name));
+        }
+
+        return std::unique_ptr<Ring>(
+            new Ring(name, false, static_cast<uint8_t *>(base), length));
+    }
+
+    const std::string &Ring::name() const
+    {
+        return name_;
+    }
+
+    const uint32_t Ring::slots() const
+    {
+        return count_;
+    }
+
+    const size_t Ring::slot_size() const
+    {
+        return slot_size_;
+    }
+
+    uint8_t *Ring::data(uint32_t p_slot) const
+    {
+        return data_ + static_cast<size_t>(p_slot) * slot_size_;
+    }
+
+    const bool Ring::push(size_t p_queue, uint32_t p_value)
+    {
+        // Bounded MPMC queue of Dmitry Vyukov, the per cell sequence tells
+        // whether the cell is free for this lap of the enqueue cursor
+        Queue &queue = header_->queues[p_queue];
+        Cell *cells = cells_[p_queue];
+        const uint64_t mask = count_ - 1;
+
+        uint64_t position =
+            queue.enqueue.position.load(std::memory_order_relaxed);
+        Cell *cell = nullptr;
+        for (;;)
+        {
+            cell = &cells[position & mask];
+            const uint64_t sequence =
+                cell->sequence.load(std::memory_order_acquire);
+            const int64_t diff = static_cast<int64_t>(sequence - position);
+            if (diff == 0)
+            {
+                if (queue.enqueue.position.compare_exchange_weak(
+                        position, position + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position =
+                    queue.enqueue.position.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = p_value;
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::optional<uint32_t> Ring::pop(size_t p_queue)
+    {
+        Queue &queue = header_->queues[p_queue];
+        Cell *cells = cells_[p_queue];
+        const uint64_t mask = count_ - 1;
+
+        uint64_t position =
+            queue.dequeue.position.load(std::memory_order_relaxed);
+        Cell *cell = nullptr;
+        for (;;)
+        {
+            cell = &cells[position & mask];
+            const uint64_t sequence =
+                cell->sequence.load(std::memory_order_acquire);
+            const int64_t diff =
+                static_cast<int64_t>(sequence - (position + 1));
+            if (diff == 0)
+            {
+                if (queue.dequeue.position.compare_exchange_weak(
+                        position, position + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return std::nullopt;
+            }
+            else
+            {
+                position =
+                    queue.dequeue.position.load(std::memory_order_relaxed);
+            }
+        }
+
+        const uint32_t value = cell->value;
+        cell->sequence.store(position + mask + 1, std::memory_order_release);
+        return value;
+    }
+
+    std::optional<uint32_t> Ring::acquire()
+    {
+        return Ring::pop(FREE);
+    }
+
+    void Ring::publish(uint32_t p_slot, uint64_t p_id, size_t p_size)
+    {
+        if (p_slot >= count_)
+            throw exception::Ring(fmt::format("slot {} out of range", p_slot));
+
+        Slot &slot = slots_[p_slot];
+        slot.id = p_id;
+        slot.size = std::min<uint64_t>(p_size, slot_size_);
+
+        // Every slot is in exactly one queue, there is always room
+        (void)Ring::push(READY, p_slot);
+    }
+
+    const bool Ring::submit(std::string_view p_data, uint64_t p_id)
+    {
+        if (p_data.size() > slot_size_)
+            throw exception::Ring(
+                fmt::format("{} bytes do not fit a {} byte slot",
+                            p_data.size(),
+                            slot_size_));
+
+        const std::optional<uint32_t> slot = Ring::acquire();
+        if (!slot)
+            return false;
+
+        std::memcpy(Ring::data(*slot), p_data.data(), p_data.size());
+        Ring::publish(*slot, p_id, p_data.size());
+        return true;
+    }
+
+    std::optional<RingVerdict> Ring::collect()
+    {
+        const std::optional<uint32_t> index = Ring::pop(DONE);
+        if (!index)
+            return std::nullopt;
+
+        const Slot &slot = slots_[*index];
+        const size_t length = std::min<size_t>(slot.length, VERDICT_SIZE);
+
+        RingVerdict verdict;
+        verdict.id = slot.id;
+        verdict.matches = slot.matches;
+        verdict.truncated = slot.truncated != 0;
+        if (slot.failed)
+        {
+            verdict.error.assign(slot.verdict, length);
+        }
+        else
+        {
+            for (size_t begin = 0; begin < length;)
+            {
+                const size_t end = std::find(slot.verdict + begin,
+                                             slot.verdict + length,
+                                             '\0') -
+                                   slot.verdict;
+                verdict.rules.emplace_back(slot.verdict + begin, end - begin);
+                begin = end + 1;
+            }
+        }
+
+        (void)Ring::push(FREE, *index);
+        return verdict;
+    }
+
+    std::optional<uint32_t> Ring::take()
+    {
+        // Producers may write the queue cells themselves
+        while (const std::optional<uint32_t> index = Ring::pop(READY))
+        {
+            if (*index < count_)
+                return index;
+        }
+        return std::nullopt;
+    }
+
+    const size_t Ring::size(uint32_t p_slot) const
+    {
+        // publish clamps too, a producer writing the slot does not
+        return static_cast<size_t>(
+            std::min<uint64_t>(slots_[p_slot].size, slot_size_));
+    }
+
+    const uint64_t Ring::id(uint32_t p_slot) const
+    {
+        return slots_[p_slot].id;
+    }
+
+    void Ring::complete(uint32_t p_slot, const yara::type::ScanResult &p_result)
+    {
+        Slot &slot = slots_[p_slot];
+        slot.failed = p_result.error.empty() ? 0 : 1;
+        slot.matches = static_cast<uint32_t>(p_result.matches.size());
+        slot.truncated = 0;
+
+        size_t length = 0;
+        if (slot.failed)
+        {
+            length = std::min(p_result.error.size(), VERDICT_SIZE);
+            std::memcpy(slot.verdict, p_result.error.data(), length);
+        }
+        else
+        {
+            // NUL separated "namespace:identifier", whole names only
+            for (const auto &match : p_result.matches)
+            {
+                const std::string rule =
+                    fmt::format("{}:{}", match.ns, match.identifier);
+                if (length + rule.size() + 1 > VERDICT_SIZE)
+                {
+                    slot.truncated = 1;
+                    break;
+                }
+                std::memcpy(slot.verdict + length, rule.data(), rule.size());
+                length += rule.size();
+                slot.verdict[length++] = '\0';
+            }
+        }
+        slot.length = static_cast<uint32_t>(length);
+
+        (void)Ring::push(DONE, p_slot);
+    }
+} // namespace yara
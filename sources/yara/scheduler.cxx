@@ -0,0 +1,343 @@
+#include <algorithm>
+#include <fmt/core.h>
+#include <sys/stat.h>
+#include <yara/emitter.hxx>
+#include <yara/exception.hxx>
+#include <yara/scheduler.hxx>
+#include <yara/yara.hxx>
+
+namespace yara
+{
+    namespace
+    {
+        uint64_t elapsed_ns(std::chrono::steady_clock::time_point p_since)
+        {
+            return static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - p_since)
+                    .count());
+        }
+    } // namespace
+
+    Scheduler::Scheduler(const yara::Yara &p_yara,
+                         const SchedulerOptions &p_options)
+        : yara_(p_yara), fast_limit_(p_options.fast_limit),
+          steal_pressure_(p_options.steal_pressure),
+          results_(std::max<size_t>(p_options.results, 1)), next_id_(1),
+          outstanding_(0), stopping_(false)
+    {
+        const std::array<LaneOptions, 3> options = {
+            p_options.fast, p_options.bulk, p_options.priority};
+        for (size_t i = 0; i < lanes_.size(); ++i)
+        {
+            lanes_[i] = std::make_unique<Lane>(
+                std::max<size_t>(options[i].capacity, 1));
+            lanes_[i]->workers = std::max<size_t>(options[i].workers, 1);
+        }
+
+        try
+        {
+            for (size_t i = 0; i < lanes_.size(); ++i)
+            {
+                for (size_t n = 0; n < lanes_[i]->workers; ++n)
+                {
+                    workers_.emplace_back(&Scheduler::work,
+                                          this,
+                                          static_cast<yara::type::Lane>(i));
+                }
+            }
+        }
+        catch (...)
+        {
+            stopping_.store(true);
+            Scheduler::close();
+            results_.close();
+            for (auto &worker : workers_)
+            {
+                worker.join();
+            }
+            throw;
+        }
+    }
+
+    Scheduler::~Scheduler()
+    {
+        // Queued jobs are dropped, a worker blocked on a full result
+        // queue is released by closing it
+        stopping_.store(true);
+        Scheduler::close();
+        results_.close();
+        for (auto &worker : workers_)
+        {
+            if (worker.joinable())
+                worker.join();
+        }
+    }
+
+    Scheduler::Lane &Scheduler::lane(yara::type::Lane p_lane) const
+    {
+        if (static_cast<size_t>(p_lane) >= lanes_.size())
+        {
+            throw yara::exception::Scan(fmt::format(
+                "scheduler: unknown lane {}", static_cast<int>(p_lane)));
+        }
+        return *lanes_[static_cast<size_t>(p_lane)];
+    }
+
+    uint64_t Scheduler::submit_bytes(std::string p_data,
+                                     const std::string &p_name,
+                                     yara::type::Lane p_lane,
+                                     yara::type::Flags p_flags,
+                                     const yara::type::ScanOptions &p_options)
+    {
+        Job job;
+        job.path = p_name;
+        job.flags = p_flags;
+        job.options = p_options;
+        const size_t size = p_data.size();
+        job.data = std::move(p_data);
+        return Scheduler::submit(std::move(job), p_lane, size);
+    }
+
+    uint64_t Scheduler::submit_file(const std::string &p_path,
+                                    yara::type::Lane p_lane,
+                                    yara::type::Flags p_flags,
+                                    const yara::type::ScanOptions &p_options)
+    {
+        size_t size = 0;
+        if (p_lane == yara::type::Lane::Auto)
+        {
+            // A file that can not be stat'ed fails fast in the fast lane
+            struct stat st;
+            if (stat(p_path.c_str(), &st) == 0)
+                size = static_cast<size_t>(st.st_size);
+        }
+
+        Job job;
+        job.file = true;
+        job.path = p_path;
+        job.flags = p_flags;
+        job.options = p_options;
+        return Scheduler::submit(std::move(job), p_lane, size);
+    }
+
+    uint64_t Scheduler::submit(Job &&p_job,
+                               yara::type::Lane p_lane,
+                               size_t p_size)
+    {
+        if (p_lane == yara::type::Lane::Auto)
+        {
+            p_lane = p_size <= fast_limit_ ? yara::type::Lane::Fast
+                                           : yara::type::Lane::Bulk;
+        }
+        Lane &target = Scheduler::lane(p_lane);
+        p_job.id = next_id_++;
+        p_job.queued = std::chrono::steady_clock::now();
+
+        const uint64_t id = p_job.id;
+        ++outstanding_;
+        if (!target.jobs.try_push(std::move(p_job)))
+        {
+            --outstanding_;
+            ++target.rejected;
+            return 0;
+        }
+        ++target.submitted;
+
+        // Fast workers sleep on wake_, not on the queue they take from
+        if (p_lane == yara::type::Lane::Fast ||
+            (p_lane == yara::type::Lane::Priority && Scheduler::backed_up()))
+            Scheduler::wake(false);
+        return id;
+    }
+
+    const bool Scheduler::backed_up() const
+    {
+        const Lane &priority = Scheduler::lane(yara::type::Lane::Priority);
+        const size_t queued = priority.jobs.size();
+        return queued > 0 && static_cast<double>(queued) /
+                                     static_cast<double>(
+                                         priority.jobs.capacity()) >=
+                                 steal_pressure_;
+    }
+
+    void Scheduler::wake(bool p_all)
+    {
+        // Taking the lock orders the push before a waiter's check
+        {
+            const std::lock_guard<std::mutex> lock(wake_mutex_);
+        }
+        if (p_all)
+            wake_.notify_all();
+        else
+            wake_.notify_one();
+    }
+
+    void Scheduler::work(yara::type::Lane p_lane)
+    {
+        Lane &own = Scheduler::lane(p_lane);
+        Lane &priority = Scheduler::lane(yara::type::Lane::Priority);
+
+        for (;;)
+        {
+            if (p_lane == yara::type::Lane::Fast)
+            {
+                if (Scheduler::backed_up())
+                {
+                    if (auto job = priority.jobs.try_pop())
+                    {
+                        Scheduler::run(std::move(*job),
+                                       yara::type::Lane::Priority);
+                        continue;
+                    }
+                }
+
+                if (auto job = own.jobs.try_pop())
+                {
+                    Scheduler::run(std::move(*job), p_lane);
+                    continue;
+                }
+                if (own.jobs.closed())
+                    return;
+
+                std::unique_lock<std::mutex> lock(wake_mutex_);
+                wake_.wait(lock,
+                           [&]()
+                           {
+                               return own.jobs.size() > 0 ||
+                                      own.jobs.closed() ||
+                                      Scheduler::backed_up();
+                           });
+                continue;
+            }
+
+            auto job = own.jobs.pop();
+            if (!job)
+                return;
+            Scheduler::run(std::move(*job), p_lane);
+        }
+    }
+
+    void Scheduler::run(Job &&p_job, yara::type::Lane p_lane)
+    {
+        Lane &lane = Scheduler::lane(p_lane);
+
+        JobResult done;
+        done.id = p_job.id;
+        done.lane = p_lane;
+        done.result.path = std::move(p_job.path);
+        // The job emits once below, the scan must not emit too
+        const std::shared_ptr<yara::Emitter> emitter =
+            std::move(p_job.options.emitter);
+        done.result.detailed = emitter != nullptr;
+        done.wait_ns = elapsed_ns(p_job.queued);
+        lane.wait.record(done.wait_ns);
+
+        if (stopping_.load())
+            return;
+
+        const auto started = std::chrono::steady_clock::now();
+        try
+        {
+            if (p_job.file)
+            {
+                yara_.scan_file(done.result.path,
+                                &yara::Yara::collect,
+                                &done.result,
+                                p_job.flags,
+                                p_job.options);
+            }
+            else
+            {
+                yara_.scan_mem(
+                    reinterpret_cast<const uint8_t *>(p_job.data.data()),
+                    p_job.data.size(),
+                    &yara::Yara::collect,
+                    &done.result,
+                    p_job.flags,
+                    p_job.options);
+            }
+            done.result.exit = yara::Yara::last_exit();
+            done.result.digests = yara::Yara::last_digests();
+        }
+        catch (const std::exception &e)
+        {
+            done.result.error = e.what();
+        }
+        done.service_ns = elapsed_ns(started);
+        lane.service.record(done.service_ns);
+        ++lane.completed;
+
+        // Emitted jobs never reach the result queue
+        if (emitter)
+        {
+            emitter->emit(done.result);
+            --outstanding_;
+            return;
+        }
+
+        // Blocks while nobody polls, which in turn fills the lanes
+        if (!results_.push(std::move(done)))
+            --outstanding_;
+    }
+
+    std::vector<JobResult> Scheduler::poll(size_t p_max,
+                                           std::chrono::milliseconds p_timeout)
+    {
+        std::vector<JobResult> results;
+        std::optional<JobResult> first = p_timeout.count() > 0
+                                             ? results_.pop_for(p_timeout)
+                                             : results_.try_pop();
+        if (!first)
+            return results;
+
+        results.push_back(std::move(*first));
+        while (p_max == 0 || results.size() < p_max)
+        {
+            auto next = results_.try_pop();
+            if (!next)
+                break;
+            results.push_back(std::move(*next));
+        }
+
+        outstanding_ -= results.size();
+        return results;
+    }
+
+    size_t Scheduler::outstanding() const
+    {
+        return outstanding_.load();
+    }
+
+    double Scheduler::pressure(yara::type::Lane p_lane) const
+    {
+        const Lane &target = Scheduler::lane(p_lane);
+        return static_cast<double>(target.jobs.size()) /
+               static_cast<double>(target.jobs.capacity());
+    }
+
+    LaneStats Scheduler::stats(yara::type::Lane p_lane) const
+    {
+        const Lane &target = Scheduler::lane(p_lane);
+
+        LaneStats stats;
+        stats.queued = target.jobs.size();
+        stats.capacity = target.jobs.capacity();
+        stats.workers = target.workers;
+        stats.submitted = target.submitted.load();
+        stats.rejected = target.rejected.load();
+        stats.completed = target.completed.load();
+        stats.wait = target.wait.report();
+        stats.service = target.service.report();
+        return stats;
+    }
+
+    void Scheduler::close()
+    {
+        for (auto &lane : lanes_)
+        {
+            lane->jobs.close();
+        }
+        Scheduler::wake(true);
+    }
+} // namespace yara
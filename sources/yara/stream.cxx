@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <interfaces/iexception.hxx>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <yara/stream.hxx>
+
+namespace yara
+{
+    namespace stream
+    {
+        Memory::Memory(std::string_view p_buffer)
+            : buffer_(p_buffer), offset_(0), stream_{}
+        {
+            stream_.read = &Memory::read;
+        }
+
+        YR_STREAM &Memory::get()
+        {
+            stream_.user_data = static_cast<void *>(this);
+            return stream_;
+        }
+
+        size_t Memory::read(void *p_ptr,
+                            size_t p_size,
+                            size_t p_count,
+                            void *p_user_data)
+        {
+            auto *self = static_cast<Memory *>(p_user_data);
+            if (IS_NULL(self) || p_size == 0)
+                return 0;
+
+            const size_t available = self->buffer_.size() - self->offset_;
+            const size_t count = std::min(p_count, available / p_size);
+
+            std::memcpy(p_ptr, self->buffer_.data() + self->offset_,
+                        count * p_size);
+            self->offset_ += count * p_size;
+
+            return count;
+        }
+
+        Descriptor::Descriptor(int p_fd, size_t p_buffer_size)
+            : fd_(p_fd), buffer_(p_buffer_size), begin_(0), end_(0),
+              failed_(false), stream_{}
+        {
+            stream_.read = &Descriptor::read;
+            stream_.write = &Descriptor::write;
+        }
+
+        YR_STREAM &Descriptor::get()
+        {
+            stream_.user_data = static_cast<void *>(this);
+            return stream_;
+        }
+
+        const int Descriptor::flush()
+        {
+            size_t offset = 0;
+            while (!failed_ && offset < end_)
+            {
+                const ssize_t written =
+                    ::write(fd_, buffer_.data() + offset, end_ - offset);
+                if (written < 0 && errno == EINTR)
+                    continue;
+                if (written <= 0)
+                {
+                    failed_ = true;
+                    break;
+                }
+                offset += static_cast<size_t>(written);
+            }
+            begin_ = end_ = 0;
+            return failed_ ? ERROR_WRITING_FILE : ERROR_SUCCESS;
+        }
+
+        size_t Descriptor::read(void *p_ptr,
+                                size_t p_size,
+                                size_t p_count,
+                                void *p_user_data)
+        {
+            auto *self = static_cast<Descriptor *>(p_user_data);
+            if (IS_NULL(self) || p_size == 0 || self->failed_)
+                return 0;
+
+            auto *out = static_cast<uint8_t *>(p_ptr);
+            const size_t total = p_size * p_count;
+            size_t copied = 0;
+
+            while (copied < total)
+            {
+                if (self->begin_ == self->end_)
+                {
+                    const size_t wanted = total - copied;
+                    /* big arena sections skip the buffer entirely */
+                    uint8_t *target = wanted >= self->buffer_.size()
+                                          ? out + copied
+                                          : self->buffer_.data();
+                    const size_t length = wanted >= self->buffer_.size()
+                                              ? wanted
+                                              : self->buffer_.size();
+
+                    const ssize_t got = ::read(self->fd_, target, length);
+                    if (got < 0 && errno == EINTR)
+                        continue;
+                    if (got <= 0)
+                    {
+                        self->failed_ = got < 0;
+                        break;
+                    }
+
+                    if (target != self->buffer_.data())
+                    {
+                        copied += static_cast<size_t>(got);
+                        continue;
+                    }
+                    self->begin_ = 0;
+                    self->end_ = static_cast<size_t>(got);
+                }
+
+                const size_t chunk =
+                    std::min(total - copied, self->end_ - self->begin_);
+                std::memcpy(out + copied, self->buffer_.data() + self->begin_,
+                            chunk);
+                self->begin_ += chunk;
+                copied += chunk;
+            }
+
+            return copied / p_size;
+        }
+
+        size_t Descriptor::write(const void *p_ptr,
+                                 size_t p_size,
+                                 size_t p_count,
+                                 void *p_user_data)
+        {
+            auto *self = static_cast<Descriptor *>(p_user_data);
+            if (IS_NULL(self) || p_size == 0 || self->failed_)
+                return 0;
+
+            const auto *in = static_cast<const uint8_t *>(p_ptr);
+            const size_t total = p_size * p_count;
+            size_t consumed = 0;
+
+            while (consumed < total)
+            {
+                if (self->end_ == self->buffer_.size() &&
+                    self->flush() != ERROR_SUCCESS)
+                    break;
+
+                const size_t chunk = std::min(total - consumed,
+                                              self->buffer_.size() - self->end_);
+                std::memcpy(self->buffer_.data() + self->end_, in + consumed,
+                            chunk);
+                self->end_ += chunk;
+                consumed += chunk;
+            }
+
+            return consumed / p_size;
+        }
+
+        Mapped::Mapped(const std::string &p_path)
+            : data_(MAP_FAILED), size_(0), error_(ERROR_SUCCESS)
+        {
+            const int fd = open(p_path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1)
+            {
+                error_ = ERROR_COULD_NOT_OPEN_FILE;
+                return;
+            }
+
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size <= 0)
+            {
+                close(fd);
+                error_ = ERROR_INVALID_FILE;
+                return;
+            }
+
+            size_ = static_cast<size_t>(st.st_size);
+            data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+
+            if (data_ == MAP_FAILED)
+            {
+                error_ = ERROR_COULD_NOT_MAP_FILE;
+                return;
+            }
+
+            madvise(data_, size_, MADV_SEQUENTIAL);
+            madvise(data_, size_, MADV_WILLNEED);
+            memory_ = Memory(
+                std::string_view(static_cast<const char *>(data_), size_));
+        }
+
+        Mapped::~Mapped()
+        {
+            if (data_ != MAP_FAILED)
+            {
+                munmap(data_, size_);
+            }
+        }
+
+        const int Mapped::error() const
+        {
+            return error_;
+        }
+
+        YR_STREAM &Mapped::get()
+        {
+            return memory_.get();
+        }
+
+        std::string_view Mapped::view() const
+        {
+            if (data_ == MAP_FAILED)
+                return {};
+            return {static_cast<const char *>(data_), size_};
+        }
+    } // namespace stream
+} // namespace yara
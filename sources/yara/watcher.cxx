@@ -0,0 +1,260 @@
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <yara/exception.hxx>
+#include <yara/watcher.hxx>
+#include <yara/yara.hxx>
+
+namespace yara
+{
+    namespace
+    {
+        constexpr uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_CREATE |
+                                        IN_DELETE | IN_MOVED_FROM |
+                                        IN_MOVED_TO | IN_DELETE_SELF |
+                                        IN_ONLYDIR;
+
+        bool rules_file(const char *p_name)
+        {
+            const size_t size = strlen(p_name);
+            return size > 4 && strcmp(p_name + size - 4, ".yar") == 0;
+        }
+
+        /* FNV-1a of the file content, 0 when it can not be read */
+        uint64_t hash_file(const std::string &p_path)
+        {
+            const int fd = open(p_path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1)
+                return 0;
+
+            uint64_t hash = 0xcbf29ce484222325ull;
+            char buffer[64 << 10];
+            for (;;)
+            {
+                const ssize_t got = read(fd, buffer, sizeof(buffer));
+                if (got < 0 && errno == EINTR)
+                    continue;
+                if (got <= 0)
+                    break;
+                for (ssize_t i = 0; i < got; ++i)
+                {
+                    hash = (hash ^ static_cast<uint8_t>(buffer[i])) *
+                           0x100000001b3ull;
+                }
+            }
+            close(fd);
+            return hash;
+        }
+    } // namespace
+
+    Watcher::Watcher(const std::string &p_path,
+                     std::chrono::milliseconds p_debounce,
+                     Reload p_reload,
+                     Report p_report)
+        : path_(p_path), debounce_(p_debounce), reload_(std::move(p_reload)),
+          report_(std::move(p_report)), inotify_fd_(-1), stop_fd_(-1)
+    {
+        // Throws on a missing folder, before any descriptor is open
+        const auto sources = yara::Yara::collect_rules_folder(path_);
+
+        inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        stop_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (inotify_fd_ == -1 || stop_fd_ == -1)
+        {
+            const int error = errno;
+            if (inotify_fd_ != -1)
+                close(inotify_fd_);
+            if (stop_fd_ != -1)
+                close(stop_fd_);
+            throw yara::exception::LoadRules(
+                fmt::format("watch_rules() failed: {}", strerror(error)));
+        }
+
+        // The rules loaded now are the baseline, only changes reload
+        Watcher::watch_tree(path_);
+        hashes_ = Watcher::hash(sources);
+        thread_ = std::thread(&Watcher::run, this);
+    }
+
+    Watcher::~Watcher()
+    {
+        const uint64_t one = 1;
+        if (write(stop_fd_, &one, sizeof(one)) != sizeof(one))
+        {
+            /* the thread still sees the descriptor close */
+        }
+        if (thread_.joinable())
+            thread_.join();
+
+        close(inotify_fd_);
+        close(stop_fd_);
+    }
+
+    const std::string &Watcher::path() const
+    {
+        return path_;
+    }
+
+    void Watcher::watch_tree(const std::string &p_path)
+    {
+        const int wd =
+            inotify_add_watch(inotify_fd_, p_path.c_str(), WATCH_MASK);
+        if (wd == -1)
+            return;
+        watches_[wd] = p_path;
+
+        DIR *dir = opendir(p_path.c_str());
+        if (!dir)
+            return;
+
+        const struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr)
+        {
+            if (entry->d_type != DT_DIR || strcmp(entry->d_name, ".") == 0 ||
+                strcmp(entry->d_name, "..") == 0)
+                continue;
+            Watcher::watch_tree(p_path + "/" + entry->d_name);
+        }
+        closedir(dir);
+    }
+
+    std::map<std::string, uint64_t>
+    Watcher::hash(const std::vector<yara::type::RuleSource> &p_sources) const
+    {
+        std::map<std::string, uint64_t> hashes;
+        for (const auto &source : p_sources)
+        {
+            hashes.emplace(source.path, hash_file(source.path));
+        }
+        return hashes;
+    }
+
+    const bool Watcher::drain()
+    {
+        alignas(struct inotify_event) char buffer[16 << 10];
+        bool relevant = false;
+
+        for (;;)
+        {
+            const ssize_t got = read(inotify_fd_, buffer, sizeof(buffer));
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got <= 0)
+                break;
+
+            for (ssize_t at = 0; at < got;)
+            {
+                const auto *event = reinterpret_cast<const inotify_event *>(
+                    buffer + at);
+                at += sizeof(struct inotify_event) + event->len;
+
+                if (event->mask & IN_Q_OVERFLOW)
+                {
+                    relevant = true;
+                    continue;
+                }
+                if (event->mask & IN_IGNORED)
+                {
+                    watches_.erase(event->wd);
+                    continue;
+                }
+
+                const auto watch = watches_.find(event->wd);
+                if (event->mask & IN_ISDIR)
+                {
+                    // A new folder may already hold rules
+                    if (watch != watches_.end() &&
+                        event->mask & (IN_CREATE | IN_MOVED_TO))
+                        Watcher::watch_tree(watch->second + "/" +
+                                            event->name);
+                    relevant = true;
+                }
+                else if (event->mask & IN_DELETE_SELF ||
+                         (event->len > 0 && rules_file(event->name)))
+                {
+                    relevant = true;
+                }
+            }
+        }
+        return relevant;
+    }
+
+    const bool Watcher::rescan()
+    {
+        std::vector<yara::type::RuleSource> sources;
+        try
+        {
+            sources = yara::Yara::collect_rules_folder(path_);
+        }
+        catch (const std::exception &e)
+        {
+            report_({yara::type::Failed, path_, 0, e.what()});
+            return true;
+        }
+
+        // Folders removed and created again lost their watch
+        Watcher::watch_tree(path_);
+
+        auto hashes = Watcher::hash(sources);
+        if (hashes == hashes_)
+            return true;
+
+        if (!reload_(std::move(sources)))
+            return false;
+
+        // A broken edit is not retried until the files change again
+        hashes_ = std::move(hashes);
+        return true;
+    }
+
+    void Watcher::run()
+    {
+        using clock = std::chrono::steady_clock;
+
+        bool dirty = false;
+        clock::time_point deadline;
+        for (;;)
+        {
+            int timeout = -1;
+            if (dirty)
+            {
+                timeout = static_cast<int>(std::max<int64_t>(
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                        deadline - clock::now())
+                        .count(),
+                    0));
+            }
+
+            struct pollfd fds[2] = {{inotify_fd_, POLLIN, 0},
+                                    {stop_fd_, POLLIN, 0}};
+            const int ready = poll(fds, 2, timeout);
+            if (ready < 0 && errno == EINTR)
+                continue;
+            if (ready < 0 || fds[1].revents != 0)
+                return;
+
+            if (fds[0].revents & POLLIN)
+            {
+                // Every change pushes the reload back by the debounce
+                if (Watcher::drain())
+                {
+                    dirty = true;
+                    deadline = clock::now() + debounce_;
+                }
+                continue;
+            }
+
+            if (dirty && clock::now() >= deadline)
+            {
+                dirty = !Watcher::rescan();
+                deadline = clock::now() + debounce_;
+            }
+        }
+    }
+} // namespace yara
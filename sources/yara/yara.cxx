@@ -1,16 +1,93 @@
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
 #include <dirent.h>
 #include <yara/exception.hxx>
+#include <yara/archive.hxx>
+#include <yara/digest.hxx>
+#include <yara/emitter.hxx>
+#include <yara/prefetch.hxx>
+#include <yara/registry.hxx>
+#include <yara/stream.hxx>
+#include <yara/watcher.hxx>
 #include <yara/yara.hxx>
 #include <fcntl.h>
 #include <fmt/core.h>
+#include <iterator>
 #include <mutex>
 #include <sys/types.h>
 #include <unistd.h>
+#include <type_traits>
 #include <utility>
+#include <variant>
+#include <vector>
 
 namespace yara
 {
+    namespace
+    {
+        /* reports of the last scan run by this thread */
+        thread_local yara::type::ExitReport thread_exit;
+        thread_local yara::DigestMap thread_digests;
+        /* instances whose rules_mutex_ this thread holds shared, in
+         * rules_foreach or a scan, where taking it again would deadlock */
+        thread_local std::vector<const yara::Yara *> thread_rules_held;
+
+        bool rules_held(const yara::Yara *p_yara)
+        {
+            return std::find(thread_rules_held.begin(),
+                             thread_rules_held.end(),
+                             p_yara) != thread_rules_held.end();
+        }
+
+        /* runs the scan while the digests are hashed over the same bytes */
+        template <typename Scan>
+        const int with_digests(const yara::type::ScanOptions &p_options,
+                               const uint8_t *p_data,
+                               size_t p_size,
+                               Scan &&p_scan)
+        {
+            thread_digests.clear();
+            std::future<yara::DigestMap> digests;
+            if (p_options.digests != 0)
+                digests =
+                    yara::Digests::start(p_options.digests, p_data, p_size);
+
+            const int scan_result = p_scan();
+            if (digests.valid())
+                thread_digests = digests.get();
+            return scan_result;
+        }
+    } // namespace
+
+    /* rules_mutex_ held shared around caller code, see toggle() */
+    class Yara::RulesLock
+    {
+    public:
+        explicit RulesLock(const Yara &p_yara)
+            : yara_(p_yara), lock_(p_yara.rules_mutex_)
+        {
+            thread_rules_held.push_back(&yara_);
+        }
+
+        ~RulesLock()
+        {
+            thread_rules_held.pop_back();
+            lock_.unlock();
+            if (!rules_held(&yara_))
+                yara_.apply_pending();
+        }
+
+    private:
+        const Yara &yara_;
+        std::shared_lock<std::shared_mutex> lock_;
+
+        RulesLock(const RulesLock &) = delete;
+        RulesLock &operator=(const RulesLock &) = delete;
+    };
+
     std::mutex Yara::lifecycle_mutex_;
     size_t Yara::lifecycle_refs_ = 0;
 
@@ -18,35 +95,55 @@ namespace yara
         : yara_compiler_(nullptr),
           yara_rules_(nullptr),
           compiler_callback_user_data_(nullptr),
-          compiler_callback_cleanup_(nullptr)
+          compiler_callback_cleanup_(nullptr),
+          rules_shared_(false),
+          compiling_(false)
     {
-        {
-            std::lock_guard<std::mutex> lock(lifecycle_mutex_);
-            if (lifecycle_refs_ == 0 && yr_initialize() != ERROR_SUCCESS)
-            {
-                throw yara::exception::Initialize(
-                    "yr_initialize() error initialize yara");
-            }
-            ++lifecycle_refs_;
-        }
+        Yara::lifecycle_acquire();
 
         const int yr_compiler = Yara::load_compiler();
         if (yr_compiler != ERROR_SUCCESS)
         {
-            std::lock_guard<std::mutex> lock(lifecycle_mutex_);
-            if (lifecycle_refs_ > 0)
-            {
-                --lifecycle_refs_;
-                if (lifecycle_refs_ == 0)
-                {
-                    yr_finalize();
-                }
-            }
+            Yara::lifecycle_release();
             throw yara::exception::Initialize(
                 "yr_compiler_create() error initialize compiler yara");
         }
     }
 
+    void Yara::lifecycle_acquire()
+    {
+        std::lock_guard<std::mutex> lock(lifecycle_mutex_);
+        if (lifecycle_refs_ == 0 && yr_initialize() != ERROR_SUCCESS)
+        {
+            throw yara::exception::Initialize(
+                "yr_initialize() error initialize yara");
+        }
+        ++lifecycle_refs_;
+    }
+
+    void Yara::lifecycle_release()
+    {
+        std::lock_guard<std::mutex> lock(lifecycle_mutex_);
+        if (lifecycle_refs_ > 0)
+        {
+            --lifecycle_refs_;
+            if (lifecycle_refs_ == 0)
+            {
+                yr_finalize();
+            }
+        }
+    }
+
+    yara::type::Rules Yara::own_rules(YR_RULES *p_rules)
+    {
+        return yara::type::Rules(p_rules,
+                                 [](YR_RULES *rules)
+                                 {
+                                     if (!IS_NULL(rules))
+                                         yr_rules_destroy(rules);
+                                 });
+    }
+
     const int Yara::load_compiler()
     {
         std::lock_guard<std::mutex> lock(compiler_mutex_);
@@ -66,26 +163,30 @@ namespace yara
 
     void Yara::unload_rules()
     {
-        std::unique_lock<std::shared_mutex> lock(rules_mutex_);
-        if (!IS_NULL(yara_rules_))
+        yara::type::Rules previous;
         {
-            if (yr_rules_destroy(yara_rules_) != ERROR_SUCCESS)
-            {
-                /* nothing */
-            }
-            yara_rules_ = nullptr;
+            std::unique_lock<std::shared_mutex> lock(rules_mutex_);
+            Yara::clear_scanners();
+            const std::lock_guard<std::mutex> toggles_lock(toggles_mutex_);
+            previous = std::exchange(yara_rules_, nullptr);
+            rules_index_.reset();
+            rules_shared_ = false;
         }
     }
 
     void Yara::rules_foreach(
         const std::function<void(const YR_RULE &)> &p_callback)
     {
-        const std::shared_lock<std::shared_mutex> lock(rules_mutex_);
+        // Only the rules table needs the lock, the callback may freely use
+        // the per rule helpers below, its toggles apply once this returns
+        const RulesLock lock(*this);
+        if (IS_NULL(yara_rules_))
+            return;
+
         const YR_RULE *rule;
-        yr_rules_foreach(yara_rules_, rule)
+        yr_rules_foreach(yara_rules_.get(), rule)
         {
-            execute_safely([&]()
-                           { p_callback(*rule); });
+            p_callback(*rule);
         }
     }
 
@@ -93,12 +194,12 @@ namespace yara
         YR_RULE *p_rule,
         const std::function<void(const YR_STRING &)> &p_callback)
     {
-        const std::shared_lock<std::shared_mutex> lock(rules_mutex_);
+        // Callers hand a rule they already hold (from rules_foreach or a
+        // scan callback), locking again here would recurse on rules_mutex_
         YR_STRING *string;
         yr_rule_strings_foreach(p_rule, string)
         {
-            execute_safely([&]()
-                           { p_callback(*string); });
+            p_callback(*string);
         }
     }
 
@@ -106,12 +207,10 @@ namespace yara
         YR_RULE *p_rule,
         const std::function<void(const YR_META &)> &p_callback)
     {
-        const std::shared_lock<std::shared_mutex> lock(rules_mutex_);
         const YR_META *meta;
         yr_rule_metas_foreach(p_rule, meta)
         {
-            execute_safely([&]()
-                           { p_callback(*meta); });
+            p_callback(*meta);
         }
     }
 
@@ -119,51 +218,260 @@ namespace yara
         YR_RULE *p_rule,
         const std::function<void(const char *)> &p_callback)
     {
-        const std::shared_lock<std::shared_mutex> lock(rules_mutex_);
         const char *tag;
         yr_rule_tags_foreach(p_rule, tag)
         {
-            execute_safely([&]()
-                           { p_callback(tag); });
+            p_callback(tag);
         }
     }
 
     const int Yara::load_rules_file(const char *p_file)
     {
-        const std::unique_lock<std::shared_mutex> lock(rules_mutex_);
-        return yr_rules_load(p_file, &yara_rules_);
+        YR_RULES *rules = nullptr;
+        const int error_success = yr_rules_load(p_file, &rules);
+        if (error_success == ERROR_SUCCESS)
+        {
+            Yara::install_rules(rules);
+        }
+        return error_success;
     }
 
     void Yara::rule_disable(YR_RULE &p_rule)
     {
-        yr_rule_disable(&p_rule);
+        // Remembered by full name so a reload disables it again
+        (void)Yara::toggle(
+            {yara::type::Identifier,
+             fmt::format("{}:{}", p_rule.ns->name, p_rule.identifier),
+             true});
     }
 
     void Yara::rule_enable(YR_RULE &p_rule)
     {
-        yr_rule_enable(&p_rule);
+        (void)Yara::toggle(
+            {yara::type::Identifier,
+             fmt::format("{}:{}", p_rule.ns->name, p_rule.identifier),
+             false});
+    }
+
+    const size_t Yara::rules_disable(yara::type::RuleKey p_key,
+                                     const std::string &p_name)
+    {
+        return Yara::toggle({p_key, p_name, true});
+    }
+
+    const size_t Yara::rules_enable(yara::type::RuleKey p_key,
+                                    const std::string &p_name)
+    {
+        return Yara::toggle({p_key, p_name, false});
+    }
+
+    std::vector<std::string> Yara::rules_find(yara::type::RuleKey p_key,
+                                              const std::string &p_name) const
+    {
+        // Rules live in the table a reload frees, hand out names only
+        std::shared_lock<std::shared_mutex> lock(rules_mutex_, std::defer_lock);
+        if (!rules_held(this))
+            lock.lock();
+        if (IS_NULL(rules_index_))
+            return {};
+
+        std::vector<std::string> names;
+        for (const YR_RULE *rule : rules_index_->find(p_key, p_name))
+        {
+            names.push_back(
+                fmt::format("{}:{}", rule->ns->name, rule->identifier));
+        }
+        return names;
+    }
+
+    std::vector<yara::type::RuleToggle> Yara::rules_toggled() const
+    {
+        const std::lock_guard<std::mutex> lock(toggles_mutex_);
+        return toggles_;
+    }
+
+    void Yara::rules_toggled_clear()
+    {
+        const std::lock_guard<std::mutex> lock(toggles_mutex_);
+        toggles_.clear();
+    }
+
+    const size_t Yara::toggle(yara::type::RuleToggle &&p_toggle)
+    {
+        Yara::check_writable();
+
+        // libyara reads the rule flags with plain loads while it scans,
+        // toggles wait for running scans to finish. Inside rules_foreach
+        // or a scan this thread holds the lock shared, the toggle is then
+        // applied once the outermost of those returns
+        const bool held = rules_held(this);
+        std::unique_lock<std::shared_mutex> rules_lock(rules_mutex_,
+                                                       std::defer_lock);
+        if (!held)
+            rules_lock.lock();
+        const std::lock_guard<std::mutex> lock(toggles_mutex_);
+
+        size_t selected = 0;
+        if (!IS_NULL(rules_index_))
+            selected = held ? rules_index_->find(p_toggle.key, p_toggle.name)
+                                  .size()
+                            : Yara::apply(*rules_index_, p_toggle);
+        if (held)
+            pending_.push_back(p_toggle);
+
+        // A later toggle of the same key and name replaces the earlier one
+        std::erase_if(toggles_,
+                      [&p_toggle](const yara::type::RuleToggle &p_other)
+                      {
+                          return p_other.key == p_toggle.key &&
+                                 p_other.name == p_toggle.name;
+                      });
+        toggles_.push_back(std::move(p_toggle));
+        return selected;
+    }
+
+    void Yara::apply_pending() const
+    {
+        {
+            const std::lock_guard<std::mutex> lock(toggles_mutex_);
+            if (pending_.empty())
+                return;
+        }
+
+        const std::unique_lock<std::shared_mutex> rules_lock(rules_mutex_);
+        const std::lock_guard<std::mutex> lock(toggles_mutex_);
+        // A reload in between replayed them already, applying is harmless
+        if (!IS_NULL(rules_index_))
+        {
+            for (const auto &toggle : pending_)
+            {
+                (void)Yara::apply(*rules_index_, toggle);
+            }
+        }
+        pending_.clear();
+    }
+
+    const size_t Yara::apply(const yara::RuleIndex &p_index,
+                             const yara::type::RuleToggle &p_toggle)
+    {
+        const std::vector<YR_RULE *> &rules =
+            p_index.find(p_toggle.key, p_toggle.name);
+        // Callers hold rules_mutex_ exclusively, no scan reads the flags
+        for (YR_RULE *rule : rules)
+        {
+            if (p_toggle.disabled)
+                rule->flags |= RULE_FLAGS_DISABLED;
+            else
+                rule->flags &= ~RULE_FLAGS_DISABLED;
+        }
+        return rules.size();
     }
 
     const int Yara::save_rules_file(const char *p_file)
     {
         const std::shared_lock<std::shared_mutex> lock(rules_mutex_);
-        return yr_rules_save(yara_rules_, p_file);
+        return yr_rules_save(yara_rules_.get(), p_file);
     }
 
     const int Yara::load_rules_stream(YR_STREAM &p_stream)
     {
-        const std::unique_lock<std::shared_mutex> lock(rules_mutex_);
-        return yr_rules_load_stream(&p_stream, &yara_rules_);
+        return Yara::load_rules_from(p_stream);
     }
 
     const int Yara::save_rules_stream(YR_STREAM &p_stream)
     {
         const std::shared_lock<std::shared_mutex> lock(rules_mutex_);
-        return yr_rules_save_stream(yara_rules_, &p_stream);
+        return yr_rules_save_stream(yara_rules_.get(), &p_stream);
+    }
+
+    const int Yara::load_rules_bytes(std::string_view p_buffer)
+    {
+        yara::stream::Memory stream(p_buffer);
+        return Yara::load_rules_from(stream.get());
+    }
+
+    const int Yara::load_rules_fd(int p_fd)
+    {
+        yara::stream::Descriptor stream(p_fd);
+        return Yara::load_rules_from(stream.get());
+    }
+
+    const int Yara::save_rules_fd(int p_fd)
+    {
+        yara::stream::Descriptor stream(p_fd);
+        const int error_success = Yara::save_rules_stream(stream.get());
+        if (error_success != ERROR_SUCCESS)
+        {
+            return error_success;
+        }
+        return stream.flush();
+    }
+
+    const int Yara::load_rules_mmap(const std::string &p_path)
+    {
+        yara::stream::Mapped stream(p_path);
+        if (stream.error() != ERROR_SUCCESS)
+        {
+            return stream.error();
+        }
+        return Yara::load_rules_from(stream.get());
+    }
+
+    const int Yara::load_rules_from(YR_STREAM &p_stream)
+    {
+        // Deserialize outside the lock, scans keep running on the
+        // current rules until the new ones are installed
+        YR_RULES *rules = nullptr;
+        const int error_success = yr_rules_load_stream(&p_stream, &rules);
+        if (error_success == ERROR_SUCCESS)
+        {
+            Yara::install_rules(rules);
+        }
+        return error_success;
+    }
+
+    void Yara::install_rules(YR_RULES *p_rules) const
+    {
+        Yara::install_rules(Yara::own_rules(p_rules), false);
+    }
+
+    void Yara::install_rules(yara::type::Rules p_rules, bool p_shared) const
+    {
+        // Index outside the lock, scans keep running meanwhile
+        std::shared_ptr<const yara::RuleIndex> index =
+            std::make_shared<const yara::RuleIndex>(p_rules.get());
+        {
+            const std::unique_lock<std::shared_mutex> lock(rules_mutex_);
+            Yara::clear_scanners();
+            const std::lock_guard<std::mutex> toggles_lock(toggles_mutex_);
+            std::swap(yara_rules_, p_rules);
+            std::swap(rules_index_, index);
+            rules_shared_ = p_shared;
+
+            // Shared rules are read-only, they keep the state they were
+            // published with
+            if (!p_shared)
+            {
+                for (const auto &toggle : toggles_)
+                {
+                    (void)Yara::apply(*rules_index_, toggle);
+                }
+            }
+        }
+        // The previous rules are released here, outside the lock, and
+        // destroyed once no other instance holds them
     }
 
     Yara::~Yara()
     {
+        // The watcher and a background compile install into this
+        // object, stop them first
+        Yara::unwatch_rules();
+        if (compile_thread_.joinable())
+        {
+            compile_thread_.join();
+        }
+
         const std::unique_lock<std::shared_mutex> rules_lock(rules_mutex_);
         const std::lock_guard<std::mutex> compiler_lock(compiler_mutex_);
 
@@ -178,21 +486,10 @@ namespace yara
             yara_compiler_ = nullptr;
         }
 
-        if (!IS_NULL(yara_rules_))
-        {
-            yr_rules_destroy(yara_rules_);
-            yara_rules_ = nullptr;
-        }
+        Yara::clear_scanners();
+        yara_rules_.reset();
 
-        std::lock_guard<std::mutex> lifecycle_lock(lifecycle_mutex_);
-        if (lifecycle_refs_ > 0)
-        {
-            --lifecycle_refs_;
-            if (lifecycle_refs_ == 0)
-            {
-                yr_finalize();
-            }
-        }
+        Yara::lifecycle_release();
     }
 
     const int Yara::set_rule_file(const std::string &p_path,
@@ -221,13 +518,18 @@ namespace yara
             yara_compiler_, p_rule.c_str(), p_yrns.c_str());
     }
 
-    void Yara::set_rules_folder(const std::string &p_path) const
+    std::vector<yara::type::RuleSource> Yara::collect_rules_folder(
+        const std::string &p_path)
     {
         DIR *dir = opendir(p_path.c_str());
         if (!dir)
             throw yara::exception::LoadRules(
                 fmt::format("{} : '{}'", strerror(errno), p_path));
 
+        std::vector<yara::type::RuleSource> sources;
+        const std::string ns =
+            std::filesystem::path(p_path).filename().string();
+
         const struct dirent *entry;
         while ((entry = readdir(dir)) != nullptr)
         {
@@ -239,130 +541,588 @@ namespace yara
 
             if (entry_name.extension() == ".yar")
             {
-                if (Yara::set_rule_file(full_path,
-                                        entry_name,
-                                        std::filesystem::path(p_path)
-                                            .filename()
-                                            .string()) != ERROR_SUCCESS)
-                {
-                    closedir(dir);
-                    throw yara::exception::LoadRules(
-                        "yara_set_signature_rule() failed to compile "
-                        "rule " +
-                        full_path);
-                }
+                sources.push_back({full_path, {}, ns});
             }
             else if (entry->d_type == DT_DIR)
             {
-                Yara::set_rules_folder(full_path);
+                try
+                {
+                    auto nested = Yara::collect_rules_folder(full_path);
+                    std::move(nested.begin(),
+                              nested.end(),
+                              std::back_inserter(sources));
+                }
+                catch (...)
+                {
+                    closedir(dir);
+                    throw;
+                }
             }
         }
         closedir(dir);
+        return sources;
     }
 
-    void Yara::load_rules() const
+    void Yara::set_rules_folder(const std::string &p_path) const
     {
-        Yara::compiler_rules();
+        for (const auto &source : Yara::collect_rules_folder(p_path))
+        {
+            if (Yara::set_rule_file(
+                    source.path,
+                    std::filesystem::path(source.path).filename().string(),
+                    source.ns) != ERROR_SUCCESS)
+            {
+                throw yara::exception::LoadRules(
+                    "yara_set_signature_rule() failed to compile "
+                    "rule " +
+                    source.path);
+            }
+        }
     }
 
-    void Yara::compiler_rules() const
+    std::vector<yara::type::RuleSource> Yara::expand_sources(
+        const std::vector<yara::type::RuleSource> &p_sources)
     {
-        const std::unique_lock<std::shared_mutex> rules_lock(rules_mutex_);
-        const std::lock_guard<std::mutex> compiler_lock(compiler_mutex_);
-
-        const int compiler_rules =
-            yr_compiler_get_rules(yara_compiler_, &yara_rules_);
-        if (compiler_rules != ERROR_SUCCESS)
+        std::vector<yara::type::RuleSource> sources;
+        for (const auto &source : p_sources)
         {
-            throw yara::exception::CompilerRules(
-                fmt::format("yr_compiler_get_rules() failed, error code: {}",
-                            compiler_rules));
+            if (!source.path.empty() &&
+                std::filesystem::is_directory(source.path))
+            {
+                auto nested = Yara::collect_rules_folder(source.path);
+                std::move(
+                    nested.begin(), nested.end(), std::back_inserter(sources));
+            }
+            else
+            {
+                sources.push_back(source);
+            }
         }
+        return sources;
     }
 
-    void Yara::scan_file(const std::string &p_path,
-                         YR_CALLBACK_FUNC p_callback,
-                         void *p_data,
-                         yara::type::Flags p_flags) const
+    YR_RULES *Yara::build_rules(
+        const std::vector<yara::type::RuleSource> &p_sources,
+        const std::function<void(yara::type::CompileEvent &&)> &p_emit,
+        const std::function<void(YR_COMPILER *)> &p_setup) const
     {
-        const std::shared_lock<std::shared_mutex> lock(rules_mutex_);
+        using yara::type::CompileEvent;
 
-        if (IS_NULL(yara_rules_))
+        YR_COMPILER *compiler = nullptr;
+        if (yr_compiler_create(&compiler) != ERROR_SUCCESS)
         {
-            throw yara::exception::Scan(
-                "scan_file() failed: call load_rules() first");
+            p_emit({yara::type::Failed, {}, 0, "yr_compiler_create() failed"});
+            return nullptr;
         }
 
-        const int scan_result = yr_rules_scan_file(
-            yara_rules_, p_path.c_str(), (int)p_flags, p_callback, p_data, 0);
-        if (scan_result != ERROR_SUCCESS)
         {
-            throw yara::exception::Scan(
-                fmt::format("yr_rules_scan_file() failed, error code: {}",
-                            scan_result));
+            const std::lock_guard<std::mutex> lock(compiler_mutex_);
+            for (const auto &[name, value] : compiler_externals_)
+            {
+                std::visit(
+                    [&](const auto &v)
+                    {
+                        using T = std::decay_t<decltype(v)>;
+                        if constexpr (std::is_same_v<T, bool>)
+                            yr_compiler_define_boolean_variable(
+                                compiler, name.c_str(), v ? 1 : 0);
+                        else if constexpr (std::is_same_v<T, int64_t>)
+                            yr_compiler_define_integer_variable(
+                                compiler, name.c_str(), v);
+                        else if constexpr (std::is_same_v<T, double>)
+                            yr_compiler_define_float_variable(
+                                compiler, name.c_str(), v);
+                        else
+                            yr_compiler_define_string_variable(
+                                compiler, name.c_str(), v.c_str());
+                    },
+                    value);
+            }
+        }
+
+        yr_compiler_set_callback(
+            compiler,
+            +[](int error_level,
+                const char *file_name,
+                int line_number,
+                const YR_RULE *rule,
+                const char *message,
+                void *user_data)
+            {
+                const auto &emit = *static_cast<
+                    const std::function<void(CompileEvent &&)> *>(user_data);
+                CompileEvent event{error_level == YARA_ERROR_LEVEL_ERROR
+                                       ? yara::type::Error
+                                       : yara::type::Warning,
+                                   file_name ? file_name : "",
+                                   line_number,
+                                   message ? message : ""};
+                if (!IS_NULL(rule) && !IS_NULL(rule->identifier))
+                    event.rule = rule->identifier;
+                emit(std::move(event));
+            },
+            const_cast<void *>(static_cast<const void *>(&p_emit)));
+        if (p_setup)
+            p_setup(compiler);
+
+        const size_t total = p_sources.size();
+        size_t done = 0;
+        for (const auto &source : p_sources)
+        {
+            const char *ns = source.ns.empty() ? nullptr : source.ns.c_str();
+            int errors = 0;
+            std::string file = source.path;
+            if (source.path.empty())
+            {
+                file = "<buffer>";
+                errors = yr_compiler_add_string(
+                    compiler, source.buffer.c_str(), ns);
+            }
+            else
+            {
+                const int fd = open(source.path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd == -1)
+                {
+                    p_emit({yara::type::Error,
+                            file,
+                            0,
+                            fmt::format("{}", strerror(errno))});
+                    errors = 1;
+                }
+                else
+                {
+                    errors = yr_compiler_add_fd(
+                        compiler,
+                        fd,
+                        ns,
+                        std::filesystem::path(source.path)
+                            .filename()
+                            .string()
+                            .c_str());
+                    close(fd);
+                }
+            }
+
+            if (errors != 0)
+            {
+                // libyara refuses further sources once one failed
+                yr_compiler_destroy(compiler);
+                p_emit({yara::type::Failed,
+                        file,
+                        0,
+                        fmt::format("{} error(s) compiling '{}'", errors, file),
+                        done,
+                        total});
+                return nullptr;
+            }
+
+            p_emit({yara::type::Progress, file, 0, {}, ++done, total});
+        }
+
+        YR_RULES *rules = nullptr;
+        const int error_success = yr_compiler_get_rules(compiler, &rules);
+        yr_compiler_destroy(compiler);
+        if (error_success != ERROR_SUCCESS)
+        {
+            p_emit({yara::type::Failed,
+                    {},
+                    0,
+                    fmt::format("yr_compiler_get_rules() failed, error code: {}",
+                                error_success),
+                    done,
+                    total});
+            return nullptr;
         }
+        return rules;
     }
 
-    void Yara::matches_foreach(
-        YR_SCAN_CONTEXT *p_context,
-        YR_STRING *p_string,
-        const std::function<void(const YR_MATCH &)> &p_callback)
+    void Yara::push_event(yara::type::CompileEvent &&p_event)
     {
-        const std::shared_lock<std::shared_mutex> lock(rules_mutex_);
-        const YR_MATCH *match;
-        yr_string_matches_foreach(p_context, p_string, match)
+        const std::lock_guard<std::mutex> lock(events_mutex_);
+        events_.push_back(std::move(p_event));
+    }
+
+    void Yara::compile_async(std::vector<yara::type::RuleSource> p_sources)
+    {
+        const std::lock_guard<std::mutex> lock(compile_mutex_);
+        // A watcher reload takes the same flag
+        bool idle = false;
+        if (!compiling_.compare_exchange_strong(idle, true))
         {
-            execute_safely([&]()
-                           { p_callback(*match); });
+            throw yara::exception::CompilerRules(
+                "compile_async() failed: a compile is already running");
+        }
+        if (compile_thread_.joinable())
+        {
+            compile_thread_.join();
         }
+
+        compile_thread_ = std::thread(
+            [this, sources = std::move(p_sources)]()
+            {
+                Yara::compile_install(sources);
+                compiling_.store(false);
+            });
     }
 
-    void Yara::define_integer_variable(const std::string &p_identifier,
-                                       int64_t p_value) const
+    void Yara::compile_install(
+        const std::vector<yara::type::RuleSource> &p_sources)
     {
-        const std::lock_guard<std::mutex> lock(compiler_mutex_);
-        yr_compiler_define_integer_variable(
-            yara_compiler_, p_identifier.c_str(), p_value);
+        const std::function<void(yara::type::CompileEvent &&)> emit =
+            [this](yara::type::CompileEvent &&event)
+        { Yara::push_event(std::move(event)); };
+
+        try
+        {
+            // Progress counts files once folders are expanded, so does
+            // the final event
+            const std::vector<yara::type::RuleSource> sources =
+                Yara::expand_sources(p_sources);
+            YR_RULES *rules = Yara::build_rules(sources, emit);
+            if (!IS_NULL(rules))
+            {
+                Yara::install_rules(rules);
+                emit({yara::type::Installed,
+                      {},
+                      0,
+                      {},
+                      sources.size(),
+                      sources.size()});
+            }
+        }
+        catch (const std::exception &e)
+        {
+            emit({yara::type::Failed, {}, 0, e.what()});
+        }
     }
 
-    void Yara::define_boolean_variable(const std::string &p_identifier,
-                                       bool p_value) const
+    const bool
+    Yara::reload_rules(std::vector<yara::type::RuleSource> &&p_sources)
     {
-        const std::lock_guard<std::mutex> lock(compiler_mutex_);
-        yr_compiler_define_boolean_variable(
-            yara_compiler_, p_identifier.c_str(), p_value ? 1 : 0);
+        bool idle = false;
+        if (!compiling_.compare_exchange_strong(idle, true))
+            return false;
+
+        Yara::compile_install(p_sources);
+        compiling_.store(false);
+        return true;
     }
 
-    void Yara::define_string_variable(const std::string &p_identifier,
-                                      const std::string &p_value) const
+    void Yara::watch_rules(const std::string &p_path,
+                           std::chrono::milliseconds p_debounce)
     {
-        const std::lock_guard<std::mutex> lock(compiler_mutex_);
-        yr_compiler_define_string_variable(
-            yara_compiler_, p_identifier.c_str(), p_value.c_str());
+        const std::lock_guard<std::mutex> lock(watcher_mutex_);
+        watcher_.reset();
+        watcher_ = std::make_unique<yara::Watcher>(
+            p_path,
+            p_debounce,
+            [this](std::vector<yara::type::RuleSource> &&sources)
+            { return Yara::reload_rules(std::move(sources)); },
+            [this](yara::type::CompileEvent &&event)
+            { Yara::push_event(std::move(event)); });
     }
 
-    void Yara::define_float_variable(const std::string &p_identifier,
-                                     double p_value) const
+    void Yara::unwatch_rules()
     {
-        const std::lock_guard<std::mutex> lock(compiler_mutex_);
-        yr_compiler_define_float_variable(
-            yara_compiler_, p_identifier.c_str(), p_value);
+        const std::lock_guard<std::mutex> lock(watcher_mutex_);
+        watcher_.reset();
     }
 
-    void Yara::clear_compiler_callback_locked()
+    const bool Yara::watching() const
     {
-        if (compiler_callback_cleanup_ && compiler_callback_user_data_)
-        {
-            compiler_callback_cleanup_(compiler_callback_user_data_);
-        }
-        compiler_callback_cleanup_ = nullptr;
-        compiler_callback_user_data_ = nullptr;
+        const std::lock_guard<std::mutex> lock(watcher_mutex_);
+        return watcher_ != nullptr;
     }
 
-    void Yara::set_compiler_callback(
-        YR_COMPILER_CALLBACK_FUNC p_callback,
-        void *p_user_data,
-        std::function<void(void *)> p_cleanup)
+    std::vector<yara::type::CompileEvent> Yara::compile_poll()
+    {
+        const std::lock_guard<std::mutex> lock(events_mutex_);
+        std::vector<yara::type::CompileEvent> events(
+            std::make_move_iterator(events_.begin()),
+            std::make_move_iterator(events_.end()));
+        events_.clear();
+        return events;
+    }
+
+    const bool Yara::compiling() const
+    {
+        return compiling_.load();
+    }
+
+    yara::LintReport
+    Yara::lint(const std::vector<yara::type::RuleSource> &p_sources,
+               const yara::LintOptions &p_options) const
+    {
+        yara::Linter linter(p_options);
+        const yara::type::Rules rules = Yara::own_rules(Yara::build_rules(
+            Yara::expand_sources(p_sources),
+            [&linter](yara::type::CompileEvent &&p_event)
+            { linter.diagnostic(p_event); },
+            [&linter](YR_COMPILER *p_compiler) { linter.attach(p_compiler); }));
+        return linter.report(rules.get());
+    }
+
+    void Yara::load_rules() const
+    {
+        Yara::compiler_rules();
+    }
+
+    void Yara::compiler_rules() const
+    {
+        YR_RULES *rules = nullptr;
+        {
+            const std::lock_guard<std::mutex> compiler_lock(compiler_mutex_);
+            const int compiler_rules =
+                yr_compiler_get_rules(yara_compiler_, &rules);
+            if (compiler_rules != ERROR_SUCCESS)
+            {
+                throw yara::exception::CompilerRules(fmt::format(
+                    "yr_compiler_get_rules() failed, error code: {}",
+                    compiler_rules));
+            }
+        }
+        Yara::install_rules(rules);
+    }
+
+    void Yara::scan_file(const std::string &p_path,
+                         YR_CALLBACK_FUNC p_callback,
+                         void *p_data,
+                         yara::type::Flags p_flags,
+                         const yara::type::ScanOptions &p_options) const
+    {
+        const RulesLock lock(*this);
+
+        if (IS_NULL(yara_rules_))
+        {
+            throw yara::exception::Scan(
+                "scan_file() failed: call load_rules() first");
+        }
+
+        if (p_options.digests != 0)
+        {
+            // Map it once, the scan and the digests read the same pages
+            const yara::stream::Mapped mapped(p_path);
+            if (mapped.error() != ERROR_SUCCESS &&
+                mapped.error() != ERROR_INVALID_FILE)
+            {
+                throw yara::exception::Scan(
+                    fmt::format("scan_file() failed: could not map '{}', "
+                                "error code: {}",
+                                p_path,
+                                mapped.error()));
+            }
+
+            // An empty file maps to an empty view
+            const auto *data =
+                reinterpret_cast<const uint8_t *>(mapped.view().data());
+            const size_t size = mapped.view().size();
+            Yara::run_scan(
+                "yr_scanner_scan_mem",
+                p_path,
+                p_options,
+                [&](yara::type::ScanResult *p_result)
+                {
+                    return with_digests(
+                        p_options,
+                        data,
+                        size,
+                        [&]()
+                        {
+                            return Yara::scan_with(
+                                p_options,
+                                p_callback,
+                                p_data,
+                                p_flags,
+                                p_result,
+                                [data, size](YR_SCANNER *scanner) {
+                                    return yr_scanner_scan_mem(
+                                        scanner, data, size);
+                                });
+                        });
+                });
+            return;
+        }
+
+        thread_digests.clear();
+        Yara::run_scan(
+            "yr_scanner_scan_file",
+            p_path,
+            p_options,
+            [&](yara::type::ScanResult *p_result)
+            {
+                return Yara::scan_with(
+                    p_options,
+                    p_callback,
+                    p_data,
+                    p_flags,
+                    p_result,
+                    [&p_path](YR_SCANNER *scanner)
+                    { return yr_scanner_scan_file(scanner, p_path.c_str()); });
+            });
+    }
+
+    void Yara::matches_foreach(
+        YR_SCAN_CONTEXT *p_context,
+        YR_STRING *p_string,
+        const std::function<void(const YR_MATCH &)> &p_callback)
+    {
+        // Called from scan callbacks, the scan already holds rules_mutex_
+        const YR_MATCH *match;
+        yr_string_matches_foreach(p_context, p_string, match)
+        {
+            p_callback(*match);
+        }
+    }
+
+    void Yara::define_integer_variable(const std::string &p_identifier,
+                                       int64_t p_value) const
+    {
+        const std::lock_guard<std::mutex> lock(compiler_mutex_);
+        compiler_externals_[p_identifier] = p_value;
+        yr_compiler_define_integer_variable(
+            yara_compiler_, p_identifier.c_str(), p_value);
+    }
+
+    void Yara::define_boolean_variable(const std::string &p_identifier,
+                                       bool p_value) const
+    {
+        const std::lock_guard<std::mutex> lock(compiler_mutex_);
+        compiler_externals_[p_identifier] = p_value;
+        yr_compiler_define_boolean_variable(
+            yara_compiler_, p_identifier.c_str(), p_value ? 1 : 0);
+    }
+
+    void Yara::define_string_variable(const std::string &p_identifier,
+                                      const std::string &p_value) const
+    {
+        const std::lock_guard<std::mutex> lock(compiler_mutex_);
+        compiler_externals_[p_identifier] = p_value;
+        yr_compiler_define_string_variable(
+            yara_compiler_, p_identifier.c_str(), p_value.c_str());
+    }
+
+    void Yara::define_float_variable(const std::string &p_identifier,
+                                     double p_value) const
+    {
+        const std::lock_guard<std::mutex> lock(compiler_mutex_);
+        compiler_externals_[p_identifier] = p_value;
+        yr_compiler_define_float_variable(
+            yara_compiler_, p_identifier.c_str(), p_value);
+    }
+
+    void Yara::clear_compiler_callback_locked()
+    {
+        if (compiler_callback_cleanup_ && compiler_callback_user_data_)
+        {
+            compiler_callback_cleanup_(compiler_callback_user_data_);
+        }
+        compiler_callback_cleanup_ = nullptr;
+        compiler_callback_user_data_ = nullptr;
+    }
+
+    yara::Modules &Yara::modules()
+    {
+        return modules_;
+    }
+
+    void Yara::check_writable() const
+    {
+        if (rules_shared_.load())
+        {
+            throw yara::exception::Registry(
+                "rules shared through the registry are read-only");
+        }
+    }
+
+    void Yara::publish_rules(const std::string &p_name,
+                             uint64_t p_version) const
+    {
+        yara::type::Rules rules;
+        {
+            const std::shared_lock<std::shared_mutex> lock(rules_mutex_);
+            if (IS_NULL(yara_rules_))
+            {
+                throw yara::exception::Registry(
+                    "publish_rules() failed: call load_rules() first");
+            }
+            rules = yara_rules_;
+        }
+
+        yara::Registry::instance().publish(p_name, p_version, rules);
+        // Other instances may attach from now on, keep them read-only
+        Yara::install_rules(std::move(rules), true);
+    }
+
+    void Yara::attach_rules(const std::string &p_name,
+                            uint64_t p_version) const
+    {
+        Yara::install_rules(
+            yara::Registry::instance().attach(p_name, p_version), true);
+    }
+
+    void Yara::share_rules(
+        const std::string &p_name,
+        uint64_t p_version,
+        const std::vector<yara::type::RuleSource> &p_sources) const
+    {
+        // Only the first caller compiles, concurrent callers wait for it
+        // and the rest attach without reading the sources at all
+        Yara::install_rules(
+            yara::Registry::instance().acquire(
+                p_name,
+                p_version,
+                [&]()
+                {
+                    const std::vector<yara::type::RuleSource> sources =
+                        Yara::expand_sources(p_sources);
+                    if (sources.empty())
+                    {
+                        throw yara::exception::Registry(fmt::format(
+                            "share_rules() failed: no rule sources for '{}' "
+                            "version {}",
+                            p_name,
+                            p_version));
+                    }
+
+                    std::string error;
+                    YR_RULES *rules = Yara::build_rules(
+                        sources,
+                        [&error](yara::type::CompileEvent &&p_event)
+                        {
+                            if (!error.empty())
+                                return;
+                            if (p_event.type == yara::type::Error)
+                                error = fmt::format("{}:{}: {}",
+                                                    p_event.file,
+                                                    p_event.line,
+                                                    p_event.message);
+                            else if (p_event.type == yara::type::Failed)
+                                error = p_event.message;
+                        });
+                    if (IS_NULL(rules))
+                    {
+                        throw yara::exception::CompilerRules(
+                            fmt::format("share_rules() failed: {}", error));
+                    }
+                    return Yara::own_rules(rules);
+                }),
+            true);
+    }
+
+    yara::LatencyReport Yara::scan_stats() const
+    {
+        return latency_.report();
+    }
+
+    void Yara::scan_stats_reset()
+    {
+        latency_.reset();
+    }
+
+    void Yara::set_compiler_callback(
+        YR_COMPILER_CALLBACK_FUNC p_callback,
+        void *p_user_data,
+        std::function<void(void *)> p_cleanup)
     {
         const std::lock_guard<std::mutex> lock(compiler_mutex_);
         clear_compiler_callback_locked();
@@ -377,9 +1137,10 @@ namespace yara
     void Yara::scan_bytes(const std::string &p_buffer,
                           YR_CALLBACK_FUNC p_callback,
                           void *p_data,
-                          yara::type::Flags p_flags) const
+                          yara::type::Flags p_flags,
+                          const yara::type::ScanOptions &p_options) const
     {
-        const std::shared_lock<std::shared_mutex> lock(rules_mutex_);
+        const RulesLock lock(*this);
 
         if (IS_NULL(yara_rules_))
         {
@@ -387,19 +1148,846 @@ namespace yara
                 "scan_bytes() failed: call load_rules() first");
         }
 
-        const int scan_result = yr_rules_scan_mem(
-            yara_rules_,
-            reinterpret_cast<const uint8_t *>(p_buffer.data()),
-            p_buffer.size(),
-            (int)p_flags,
-            p_callback,
-            p_data,
-            0);
-        if (scan_result != ERROR_SUCCESS)
+        const auto *data = reinterpret_cast<const uint8_t *>(p_buffer.data());
+        Yara::run_scan(
+            "yr_scanner_scan_mem",
+            p_options.name,
+            p_options,
+            [&](yara::type::ScanResult *p_result)
+            {
+                return with_digests(
+                    p_options,
+                    data,
+                    p_buffer.size(),
+                    [&]()
+                    {
+                        return Yara::scan_with(
+                            p_options,
+                            p_callback,
+                            p_data,
+                            p_flags,
+                            p_result,
+                            [data, &p_buffer](YR_SCANNER *scanner)
+                            {
+                                return yr_scanner_scan_mem(
+                                    scanner, data, p_buffer.size());
+                            });
+                    });
+            });
+    }
+
+    void Yara::scan_mem(const uint8_t *p_data,
+                        size_t p_size,
+                        YR_CALLBACK_FUNC p_callback,
+                        void *p_user_data,
+                        yara::type::Flags p_flags,
+                        const yara::type::ScanOptions &p_options) const
+    {
+        const RulesLock lock(*this);
+
+        if (IS_NULL(yara_rules_))
+        {
+            throw yara::exception::Scan(
+                "scan_mem() failed: call load_rules() first");
+        }
+
+        Yara::run_scan(
+            "yr_scanner_scan_mem",
+            p_options.name,
+            p_options,
+            [&](yara::type::ScanResult *p_result)
+            {
+                return with_digests(
+                    p_options,
+                    p_data,
+                    p_size,
+                    [&]()
+                    {
+                        return Yara::scan_with(
+                            p_options,
+                            p_callback,
+                            p_user_data,
+                            p_flags,
+                            p_result,
+                            [p_data, p_size](YR_SCANNER *scanner) {
+                                return yr_scanner_scan_mem(
+                                    scanner, p_data, p_size);
+                            });
+                    });
+            });
+    }
+
+    void Yara::scan_chunks(const std::vector<std::string_view> &p_chunks,
+                           YR_CALLBACK_FUNC p_callback,
+                           void *p_user_data,
+                           yara::type::Flags p_flags,
+                           const yara::type::ScanOptions &p_options) const
+    {
+        const RulesLock lock(*this);
+
+        if (IS_NULL(yara_rules_))
+        {
+            throw yara::exception::Scan(
+                "scan_chunks() failed: call load_rules() first");
+        }
+
+        yara::blocks::Chunks chunks(p_chunks);
+        Yara::run_scan(
+            "yr_scanner_scan_mem_blocks",
+            p_options.name,
+            p_options,
+            [&](yara::type::ScanResult *p_result)
+            {
+                thread_digests.clear();
+                std::future<yara::DigestMap> digests;
+                if (p_options.digests != 0)
+                    digests =
+                        yara::Digests::start(p_options.digests, p_chunks);
+
+                const int scan_result = Yara::scan_with(
+                    p_options,
+                    p_callback,
+                    p_user_data,
+                    p_flags,
+                    p_result,
+                    [&chunks](YR_SCANNER *scanner) {
+                        return yr_scanner_scan_mem_blocks(scanner,
+                                                          &chunks.get());
+                    });
+                if (digests.valid())
+                    thread_digests = digests.get();
+                return scan_result;
+            });
+    }
+
+    void Yara::scan_source(const yaral_block_source &p_source,
+                           YR_CALLBACK_FUNC p_callback,
+                           void *p_user_data,
+                           yara::type::Flags p_flags,
+                           const yara::type::ScanOptions &p_options) const
+    {
+        const RulesLock lock(*this);
+
+        if (IS_NULL(yara_rules_))
+        {
+            throw yara::exception::Scan(
+                "scan_source() failed: call load_rules() first");
+        }
+        if (IS_NULL(p_source.next))
         {
             throw yara::exception::Scan(
-                fmt::format("yr_rules_scan_mem() failed, error code: {}",
-                            scan_result));
+                "scan_source() failed: the source has no next function");
+        }
+        if (p_options.digests != 0)
+        {
+            // Blocks are gone once the scan moved past them
+            throw yara::exception::Scan(
+                "scan_source() failed: digests are not supported");
+        }
+
+        thread_digests.clear();
+        yara::blocks::Source source(p_source);
+        Yara::run_scan(
+            "yr_scanner_scan_mem_blocks",
+            p_options.name,
+            p_options,
+            [&](yara::type::ScanResult *p_result)
+            {
+                return Yara::scan_with(
+                    p_options,
+                    p_callback,
+                    p_user_data,
+                    p_flags,
+                    p_result,
+                    [&source](YR_SCANNER *scanner) {
+                        return yr_scanner_scan_mem_blocks(scanner,
+                                                          &source.get());
+                    });
+            });
+    }
+
+    int Yara::collect(YR_SCAN_CONTEXT *p_context,
+                      int p_message,
+                      void *p_message_data,
+                      void *p_user_data)
+    {
+        if (p_message != CALLBACK_MSG_RULE_MATCHING)
+            return CALLBACK_CONTINUE;
+
+        auto *result = static_cast<yara::type::ScanResult *>(p_user_data);
+        auto *rule = static_cast<YR_RULE *>(p_message_data);
+        yara::type::RuleMatch &match = result->matches.emplace_back();
+        match.identifier = rule->identifier;
+        match.ns = rule->ns->name;
+        if (!result->detailed)
+            return CALLBACK_CONTINUE;
+
+        // Matches live in the scan context, copy them while it exists
+        const char *tag;
+        yr_rule_tags_foreach(rule, tag)
+        {
+            match.tags.emplace_back(tag);
+        }
+
+        const YR_META *meta;
+        yr_rule_metas_foreach(rule, meta)
+        {
+            yara::type::MatchedMeta &value = match.metas.emplace_back();
+            value.identifier = meta->identifier;
+            if (meta->type == META_TYPE_INTEGER)
+                value.value = static_cast<int64_t>(meta->integer);
+            else if (meta->type == META_TYPE_BOOLEAN)
+                value.value = meta->integer != 0;
+            else
+                value.value = std::string(meta->string ? meta->string : "");
         }
+
+        YR_STRING *string;
+        yr_rule_strings_foreach(rule, string)
+        {
+            const YR_MATCH *found;
+            yr_string_matches_foreach(p_context, string, found)
+            {
+                match.strings.push_back(
+                    {string->identifier,
+                     static_cast<uint64_t>(found->base + found->offset),
+                     static_cast<uint32_t>(found->match_length)});
+            }
+        }
+        return CALLBACK_CONTINUE;
+    }
+
+    std::vector<yara::type::ScanResult> Yara::scan_archive(
+        const std::string &p_path,
+        yara::type::Flags p_flags,
+        const yara::type::ScanOptions &p_options,
+        const yara::type::ArchiveLimits &p_limits) const
+    {
+        const yara::stream::Mapped mapped(p_path);
+        if (mapped.error() != ERROR_SUCCESS)
+        {
+            throw yara::exception::Scan(
+                fmt::format("scan_archive() failed: could not map '{}', "
+                            "error code: {}",
+                            p_path,
+                            mapped.error()));
+        }
+        return Yara::scan_archive_bytes(
+            mapped.view(), p_path, p_flags, p_options, p_limits);
+    }
+
+    std::vector<yara::type::ScanResult> Yara::scan_archive_bytes(
+        std::string_view p_data,
+        const std::string &p_name,
+        yara::type::Flags p_flags,
+        const yara::type::ScanOptions &p_options,
+        const yara::type::ArchiveLimits &p_limits) const
+    {
+        {
+            const std::shared_lock<std::shared_mutex> lock(rules_mutex_);
+            if (IS_NULL(yara_rules_))
+            {
+                throw yara::exception::Scan(
+                    "scan_archive() failed: call load_rules() first");
+            }
+        }
+
+        // Members emit here, once, with the archive error if any
+        yara::type::ScanOptions scan = p_options;
+        scan.emitter.reset();
+
+        std::vector<yara::type::ScanResult> results;
+        const auto visit = [&](const std::string &p_path,
+                               const uint8_t *p_member,
+                               size_t p_size,
+                               const std::string &p_error)
+        {
+            yara::type::ScanResult &result = results.emplace_back();
+            result.path = p_path;
+            result.error = p_error;
+            result.detailed = p_options.emitter != nullptr;
+            if (!IS_NULL(p_member) || p_error.empty())
+            {
+                try
+                {
+                    Yara::scan_mem(p_member,
+                                   p_size,
+                                   &Yara::collect,
+                                   &result,
+                                   p_flags,
+                                   scan);
+                    result.exit = Yara::last_exit();
+                    result.digests = Yara::last_digests();
+                }
+                catch (const std::exception &e)
+                {
+                    if (result.error.empty())
+                        result.error = e.what();
+                }
+            }
+            if (p_options.emitter)
+                p_options.emitter->emit(result);
+        };
+
+        // One buffer per nesting level is in use at a time
+        yara::Buffers buffers(std::min(p_limits.expanded,
+                                       (p_limits.depth + 1) *
+                                           p_limits.member_size));
+        yara::Archive archive(p_limits, buffers);
+        const auto *data = reinterpret_cast<const uint8_t *>(p_data.data());
+        if (!archive.walk(p_name, data, p_data.size(), visit))
+            visit(p_name, data, p_data.size(), {});
+
+        return results;
+    }
+
+    std::vector<yara::type::ScanResult> Yara::scan_files(
+        const std::vector<std::string> &p_paths,
+        yara::type::Flags p_flags,
+        const yara::type::ScanOptions &p_options,
+        const yara::type::BulkOptions &p_bulk) const
+    {
+        std::vector<yara::type::ScanResult> results(p_paths.size());
+        for (size_t i = 0; i < p_paths.size(); ++i)
+        {
+            results[i].path = p_paths[i];
+            results[i].detailed = p_options.emitter != nullptr;
+        }
+        if (p_paths.empty())
+            return results;
+
+        // Workers emit here, read errors included
+        yara::type::ScanOptions scan = p_options;
+        scan.emitter.reset();
+
+        const size_t threads = std::max<size_t>(
+            p_bulk.threads ? p_bulk.threads
+                           : std::thread::hardware_concurrency(),
+            1);
+        const size_t depth = std::max<size_t>(p_bulk.depth, 1);
+
+        // Reads in flight, queued and being scanned all hold budget, idle
+        // buffers too until a read needs their bytes
+        const size_t budget = p_bulk.max_inflight_bytes;
+        yara::Buffers buffers(budget != 0 ? budget : p_bulk.max_size, budget);
+        yara::Queue<yara::Loaded> loaded(depth);
+
+        const auto worker = [&]()
+        {
+            while (auto item = loaded.pop())
+            {
+                yara::type::ScanResult &result = results[item->index];
+                try
+                {
+                    if (item->error != ERROR_SUCCESS)
+                    {
+                        result.error =
+                            fmt::format("could not read '{}', error code: {}",
+                                        result.path,
+                                        item->error);
+                    }
+                    else if (item->oversized)
+                    {
+                        Yara::scan_file(result.path,
+                                        &Yara::collect,
+                                        &result,
+                                        p_flags,
+                                        scan);
+                        result.exit = Yara::last_exit();
+                        result.digests = Yara::last_digests();
+                    }
+                    else
+                    {
+                        Yara::scan_mem(item->buffer.data.get(),
+                                       item->buffer.size,
+                                       &Yara::collect,
+                                       &result,
+                                       p_flags,
+                                       scan);
+                        result.exit = Yara::last_exit();
+                        result.digests = Yara::last_digests();
+                    }
+                }
+                catch (const std::exception &e)
+                {
+                    result.error = e.what();
+                }
+                if (p_options.emitter)
+                    p_options.emitter->emit(result);
+                buffers.release(std::move(item->buffer));
+            }
+        };
+
+        std::vector<std::thread> pool;
+        pool.reserve(threads);
+        {
+            const yara::Prefetch prefetch(
+                p_paths, depth, p_bulk.max_size, buffers, loaded);
+            try
+            {
+                for (size_t i = 0; i < threads; ++i)
+                {
+                    pool.emplace_back(worker);
+                }
+            }
+            catch (...)
+            {
+                // Unblock the prefetcher before unwinding
+                loaded.close();
+                buffers.close();
+                for (auto &thread : pool)
+                {
+                    thread.join();
+                }
+                throw;
+            }
+            for (auto &thread : pool)
+            {
+                thread.join();
+            }
+        }
+        return results;
+    }
+
+    YR_SCANNER *Yara::acquire_scanner() const
+    {
+        {
+            const std::lock_guard<std::mutex> lock(scanners_mutex_);
+            if (!scanners_.empty())
+            {
+                YR_SCANNER *scanner = scanners_.top();
+                scanners_.pop();
+                return scanner;
+            }
+        }
+
+        YR_SCANNER *scanner = nullptr;
+        const int error_success =
+            yr_scanner_create(yara_rules_.get(), &scanner);
+        if (error_success != ERROR_SUCCESS)
+        {
+            throw yara::exception::Scan(fmt::format(
+                "yr_scanner_create() failed, error code: {}", error_success));
+        }
+        return scanner;
+    }
+
+    void Yara::release_scanner(YR_SCANNER *p_scanner) const
+    {
+        const std::lock_guard<std::mutex> lock(scanners_mutex_);
+        scanners_.push(p_scanner);
+    }
+
+    void Yara::clear_scanners() const
+    {
+        // Callers hold rules_mutex_ exclusively, no scanner is in use
+        const std::lock_guard<std::mutex> lock(scanners_mutex_);
+        while (!scanners_.empty())
+        {
+            yr_scanner_destroy(scanners_.top());
+            scanners_.pop();
+        }
+    }
+
+    namespace
+    {
+        struct ScanContext
+        {
+            YR_CALLBACK_FUNC callback;
+            void *user_data;
+            const yara::Modules *modules;
+            const yara::type::ScanOptions *options;
+            const YR_RULES *rules;
+            yara::type::ExitReport *exit;
+            /* detailed result for the emitter, null when nothing emits */
+            yara::type::ScanResult *result;
+
+            /* module data must outlive the scan, modules may keep it */
+            std::vector<yara::type::ModuleData> held;
+            std::chrono::steady_clock::time_point import_started;
+            std::string import_name;
+            bool import_denied;
+            bool import_supplied;
+        };
+
+        /* a string meta equal to the policy value, or truthy without one */
+        const bool truthy(const std::string &p_expected, const char *p_value)
+        {
+            const std::string_view value(IS_NULL(p_value) ? "" : p_value);
+            if (!p_expected.empty())
+                return value == p_expected;
+
+            const auto same = [&value](std::string_view p_word)
+            {
+                return std::equal(value.begin(),
+                                  value.end(),
+                                  p_word.begin(),
+                                  p_word.end(),
+                                  [](char a, char b)
+                                  {
+                                      return std::tolower(
+                                                 static_cast<unsigned char>(
+                                                     a)) == b;
+                                  });
+            };
+            return same("true") || same("yes") || same("1");
+        }
+
+        const bool decisive(const yara::type::ExitPolicy &p_policy,
+                            const YR_RULE *p_rule,
+                            uint32_t p_matched)
+        {
+            if (p_policy.matches > 0 && p_matched >= p_policy.matches)
+                return true;
+
+            if (!p_policy.tag.empty())
+            {
+                const char *tag = nullptr;
+                yr_rule_tags_foreach(p_rule, tag)
+                {
+                    if (p_policy.tag == tag)
+                        return true;
+                }
+            }
+
+            if (!p_policy.meta.empty())
+            {
+                const YR_META *meta = nullptr;
+                yr_rule_metas_foreach(p_rule, meta)
+                {
+                    if (p_policy.meta != meta->identifier)
+                        continue;
+                    if (meta->type == META_TYPE_STRING)
+                    {
+                        if (truthy(p_policy.meta_value, meta->string))
+                            return true;
+                        continue;
+                    }
+                    if (meta->integer >= p_policy.meta_min)
+                        return true;
+                }
+            }
+            return false;
+        }
+
+        /* answers module imports natively, applies the early exit policy
+         * to rule reports, everything else goes to the caller callback */
+        int scan_callback(YR_SCAN_CONTEXT *p_context,
+                          int p_message,
+                          void *p_message_data,
+                          void *p_user_data)
+        {
+            auto *ctx = static_cast<ScanContext *>(p_user_data);
+            switch (p_message)
+            {
+            case CALLBACK_MSG_IMPORT_MODULE:
+            {
+                auto *import = static_cast<YR_MODULE_IMPORT *>(p_message_data);
+                ctx->import_started = std::chrono::steady_clock::now();
+                ctx->import_name = import->module_name;
+                ctx->import_supplied = false;
+                ctx->import_denied = ctx->modules->denied(
+                    ctx->options->scan_class, import->module_name);
+                if (ctx->import_denied)
+                    return CALLBACK_CONTINUE;
+
+                yara::type::ModuleData data;
+                const auto it =
+                    ctx->options->module_data.find(import->module_name);
+                if (it != ctx->options->module_data.end())
+                    data = it->second;
+                else
+                    data = ctx->modules->data(import->module_name);
+
+                if (data)
+                {
+                    import->module_data =
+                        const_cast<char *>(data->data());
+                    import->module_data_size = data->size();
+                    ctx->import_supplied = true;
+                    ctx->held.push_back(std::move(data));
+                }
+                return CALLBACK_CONTINUE;
+            }
+            case CALLBACK_MSG_MODULE_IMPORTED:
+            {
+                const auto elapsed = std::chrono::duration_cast<
+                    std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - ctx->import_started);
+                ctx->modules->record(ctx->import_name.c_str(),
+                                     ctx->import_denied,
+                                     ctx->import_supplied,
+                                     static_cast<uint64_t>(elapsed.count()));
+                break;
+            }
+            case CALLBACK_MSG_RULE_MATCHING:
+            case CALLBACK_MSG_RULE_NOT_MATCHING:
+            {
+                // libyara reports rules in table order, the position of the
+                // last one reported tells how many were left out
+                const auto *rule =
+                    static_cast<const YR_RULE *>(p_message_data);
+                ctx->exit->reported = static_cast<uint32_t>(
+                    rule - ctx->rules->rules_table + 1);
+                if (p_message == CALLBACK_MSG_RULE_NOT_MATCHING)
+                    break;
+
+                ++ctx->exit->matched;
+                if (!IS_NULL(ctx->result))
+                    (void)Yara::collect(
+                        p_context, p_message, p_message_data, ctx->result);
+                const int result = IS_NULL(ctx->callback)
+                                       ? CALLBACK_CONTINUE
+                                       : ctx->callback(p_context,
+                                                       p_message,
+                                                       p_message_data,
+                                                       ctx->user_data);
+                if (result != CALLBACK_CONTINUE ||
+                    !decisive(ctx->options->exit, rule, ctx->exit->matched))
+                    return result;
+
+                ctx->exit->stopped = true;
+                ctx->exit->rule =
+                    fmt::format("{}:{}", rule->ns->name, rule->identifier);
+                return CALLBACK_ABORT;
+            }
+            case CALLBACK_MSG_SCAN_FINISHED:
+                // Reached the end of the rule table
+                ctx->exit->reported = ctx->exit->total;
+                break;
+            default:
+                break;
+            }
+
+            if (IS_NULL(ctx->callback))
+                return CALLBACK_CONTINUE;
+            return ctx->callback(
+                p_context, p_message, p_message_data, ctx->user_data);
+        }
+
+        const YR_EXTERNAL_VARIABLE *find_external(const YR_RULES *p_rules,
+                                                  const std::string &p_name)
+        {
+            for (const YR_EXTERNAL_VARIABLE *external = p_rules->ext_vars_table;
+                 !EXTERNAL_VARIABLE_IS_NULL(external);
+                 external++)
+            {
+                if (p_name == external->identifier)
+                    return external;
+            }
+            return nullptr;
+        }
+
+        /* restore the value the variable had when rules were compiled */
+        void restore_external(YR_SCANNER *p_scanner,
+                              const YR_EXTERNAL_VARIABLE *p_external)
+        {
+            switch (p_external->type)
+            {
+            case EXTERNAL_VARIABLE_TYPE_INTEGER:
+                yr_scanner_define_integer_variable(
+                    p_scanner, p_external->identifier, p_external->value.i);
+                break;
+            case EXTERNAL_VARIABLE_TYPE_BOOLEAN:
+                yr_scanner_define_boolean_variable(
+                    p_scanner, p_external->identifier, (int)p_external->value.i);
+                break;
+            case EXTERNAL_VARIABLE_TYPE_FLOAT:
+                yr_scanner_define_float_variable(
+                    p_scanner, p_external->identifier, p_external->value.f);
+                break;
+            case EXTERNAL_VARIABLE_TYPE_STRING:
+            case EXTERNAL_VARIABLE_TYPE_MALLOC_STRING:
+                yr_scanner_define_string_variable(
+                    p_scanner,
+                    p_external->identifier,
+                    p_external->value.s ? p_external->value.s : "");
+                break;
+            }
+        }
+
+        /* define an override coercing it to the declared type */
+        const int define_external(YR_SCANNER *p_scanner,
+                                  const YR_EXTERNAL_VARIABLE *p_external,
+                                  const yara::type::External &p_value)
+        {
+            const char *name = p_external->identifier;
+            switch (p_external->type)
+            {
+            case EXTERNAL_VARIABLE_TYPE_INTEGER:
+                if (const auto *i = std::get_if<int64_t>(&p_value))
+                    return yr_scanner_define_integer_variable(
+                        p_scanner, name, *i);
+                if (const auto *f = std::get_if<double>(&p_value))
+                {
+                    // Only whole numbers in range, NaN fails both bounds
+                    constexpr double LIMIT = 9223372036854775808.0; /* 2^63 */
+                    if (!(*f >= -LIMIT && *f < LIMIT) || std::trunc(*f) != *f)
+                        break;
+                    return yr_scanner_define_integer_variable(
+                        p_scanner, name, static_cast<int64_t>(*f));
+                }
+                if (const auto *b = std::get_if<bool>(&p_value))
+                    return yr_scanner_define_integer_variable(
+                        p_scanner, name, *b ? 1 : 0);
+                break;
+            case EXTERNAL_VARIABLE_TYPE_FLOAT:
+                if (const auto *f = std::get_if<double>(&p_value))
+                    return yr_scanner_define_float_variable(
+                        p_scanner, name, *f);
+                if (const auto *i = std::get_if<int64_t>(&p_value))
+                    return yr_scanner_define_float_variable(
+                        p_scanner, name, static_cast<double>(*i));
+                break;
+            case EXTERNAL_VARIABLE_TYPE_BOOLEAN:
+                if (const auto *b = std::get_if<bool>(&p_value))
+                    return yr_scanner_define_boolean_variable(
+                        p_scanner, name, *b ? 1 : 0);
+                if (const auto *i = std::get_if<int64_t>(&p_value))
+                    return yr_scanner_define_boolean_variable(
+                        p_scanner, name, *i != 0 ? 1 : 0);
+                break;
+            case EXTERNAL_VARIABLE_TYPE_STRING:
+            case EXTERNAL_VARIABLE_TYPE_MALLOC_STRING:
+                if (const auto *str = std::get_if<std::string>(&p_value))
+                    return yr_scanner_define_string_variable(
+                        p_scanner, name, str->c_str());
+                break;
+            }
+            return ERROR_INVALID_EXTERNAL_VARIABLE_TYPE;
+        }
+    } // namespace
+
+    const int Yara::scan_with(
+        const yara::type::ScanOptions &p_options,
+        YR_CALLBACK_FUNC p_callback,
+        void *p_data,
+        yara::type::Flags p_flags,
+        yara::type::ScanResult *p_result,
+        const std::function<int(YR_SCANNER *)> &p_scan) const
+    {
+        // Caller holds rules_mutex_ shared, yara_rules_ is stable here
+        YR_SCANNER *scanner = Yara::acquire_scanner();
+        std::vector<const YR_EXTERNAL_VARIABLE *> overridden;
+        overridden.reserve(p_options.externals.size());
+
+        const auto recycle = [&]()
+        {
+            for (const YR_EXTERNAL_VARIABLE *external : overridden)
+            {
+                restore_external(scanner, external);
+            }
+            Yara::release_scanner(scanner);
+        };
+
+        for (const auto &[name, value] : p_options.externals)
+        {
+            const YR_EXTERNAL_VARIABLE *external =
+                find_external(yara_rules_.get(), name);
+            if (IS_NULL(external))
+            {
+                recycle();
+                throw yara::exception::Scan(fmt::format(
+                    "external variable '{}' is not defined", name));
+            }
+
+            overridden.push_back(external);
+            const int error_success =
+                define_external(scanner, external, value);
+            if (error_success != ERROR_SUCCESS)
+            {
+                recycle();
+                throw yara::exception::Scan(fmt::format(
+                    "external variable '{}' could not be set, error code: {}",
+                    name,
+                    error_success));
+            }
+        }
+
+        thread_exit = yara::type::ExitReport{};
+        thread_exit.total = yara_rules_->num_rules;
+        ScanContext ctx{p_callback,
+                        p_data,
+                        &modules_,
+                        &p_options,
+                        yara_rules_.get(),
+                        &thread_exit,
+                        p_result};
+        yr_scanner_set_callback(scanner, &scan_callback, &ctx);
+        yr_scanner_set_flags(scanner, (int)p_flags);
+        yr_scanner_set_timeout(scanner, 0);
+
+        const auto started = std::chrono::steady_clock::now();
+        int scan_result = ERROR_SUCCESS;
+        try
+        {
+            scan_result = p_scan(scanner);
+        }
+        catch (...)
+        {
+            recycle();
+            throw;
+        }
+        latency_.record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - started)
+                .count()));
+
+        recycle();
+        thread_exit.skipped = thread_exit.total - thread_exit.reported;
+        return scan_result;
+    }
+
+    void Yara::run_scan(
+        const char *p_call,
+        const std::string &p_name,
+        const yara::type::ScanOptions &p_options,
+        const std::function<int(yara::type::ScanResult *)> &p_scan) const
+    {
+        int scan_result = ERROR_SUCCESS;
+        if (!p_options.emitter)
+        {
+            scan_result = p_scan(nullptr);
+        }
+        else
+        {
+            // The record is built natively next to the caller callback
+            yara::type::ScanResult result;
+            result.path = p_name;
+            result.detailed = true;
+            try
+            {
+                scan_result = p_scan(&result);
+            }
+            catch (const std::exception &e)
+            {
+                result.error = e.what();
+                p_options.emitter->emit(result);
+                throw;
+            }
+
+            result.exit = thread_exit;
+            result.digests = thread_digests;
+            if (scan_result != ERROR_SUCCESS)
+                result.error = fmt::format(
+                    "{}() failed, error code: {}", p_call, scan_result);
+            p_options.emitter->emit(result);
+        }
+
+        if (scan_result != ERROR_SUCCESS)
+        {
+            throw yara::exception::Scan(fmt::format(
+                "{}() failed, error code: {}", p_call, scan_result));
+        }
+    }
+
+    const yara::type::ExitReport &Yara::last_exit()
+    {
+        return thread_exit;
+    }
+
+    const yara::DigestMap &Yara::last_digests()
+    {
+        return thread_digests;
     }
 } // namespace yara
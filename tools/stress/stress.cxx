@@ -0,0 +1,507 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <yara/exception.hxx>
+#include <yara/yara.hxx>
+
+/*
+ * yaral_stress: scans from a growing number of threads while other
+ * threads reload, toggle and iterate the same rules, then prints
+ * scans/sec and tail latency for every thread count. Build it with
+ * -DFLAGS_BUILD_STRESS=ON, the tsan and asan presets do so.
+ *
+ *   yaral_stress [--rules DIR] [--seconds N] [--max-threads N]
+ *                [--samples N] [--sample-size BYTES]
+ *
+ * Without --rules a synthetic corpus is written to a temporary folder.
+ */
+
+namespace
+{
+    namespace fs = std::filesystem;
+
+    struct Settings
+    {
+        std::string rules;
+        double seconds = 3;
+        size_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+        size_t samples = 64;
+        size_t sample_size = 256 << 10;
+    };
+
+    struct Corpus
+    {
+        fs::path root;
+        std::vector<yara::type::RuleSource> sources;
+        /* "namespace:identifier" of a few rules, tags and namespaces */
+        std::vector<std::string> identifiers;
+        std::vector<std::string> tags;
+        std::vector<std::string> namespaces;
+        std::vector<std::string> tokens;
+    };
+
+    struct Step
+    {
+        size_t threads = 0;
+        uint64_t scans = 0;
+        uint64_t errors = 0;
+        uint64_t reloads = 0;
+        uint64_t toggles = 0;
+        uint64_t iterations = 0;
+        double seconds = 0;
+        uint64_t p50_ns = 0;
+        uint64_t p99_ns = 0;
+        uint64_t max_ns = 0;
+    };
+
+    [[noreturn]] void usage(const char *p_name)
+    {
+        fmt::print(stderr,
+                   "usage: {} [--rules DIR] [--seconds N] [--max-threads N] "
+                   "[--samples N] [--sample-size BYTES]\n",
+                   p_name);
+        std::exit(2);
+    }
+
+    Settings parse(int p_argc, char **p_argv)
+    {
+        Settings settings;
+        for (int i = 1; i < p_argc; ++i)
+        {
+            const std::string arg = p_argv[i];
+            if (i + 1 >= p_argc)
+                usage(p_argv[0]);
+
+            const char *value = p_argv[++i];
+            if (arg == "--rules")
+                settings.rules = value;
+            else if (arg == "--seconds")
+                settings.seconds = std::max(std::atof(value), 0.1);
+            else if (arg == "--max-threads")
+                settings.max_threads =
+                    std::max<size_t>(std::strtoull(value, nullptr, 10), 1);
+            else if (arg == "--samples")
+                settings.samples =
+                    std::max<size_t>(std::strtoull(value, nullptr, 10), 1);
+            else if (arg == "--sample-size")
+                settings.sample_size =
+                    std::max<size_t>(std::strtoull(value, nullptr, 10), 1);
+            else
+                usage(p_argv[0]);
+        }
+        return settings;
+    }
+
+    /* two namespaces of plain, hex and regex rules with tags and metas */
+    void write_corpus(Corpus &p_corpus)
+    {
+        constexpr size_t FILES = 8;
+        constexpr size_t RULES = 64;
+        const char *namespaces[] = {"alpha", "beta"};
+
+        for (size_t n = 0; n < std::size(namespaces); ++n)
+        {
+            const fs::path folder = p_corpus.root / "rules" / namespaces[n];
+            fs::create_directories(folder);
+            p_corpus.namespaces.emplace_back(namespaces[n]);
+
+            for (size_t f = 0; f < FILES; ++f)
+            {
+                std::ofstream out(folder / fmt::format("set_{}.yar", f));
+                for (size_t r = 0; r < RULES; ++r)
+                {
+                    const std::string name =
+                        fmt::format("r_{}_{}_{}", namespaces[n], f, r);
+                    const std::string token =
+                        fmt::format("tok{}{}x{}q", n, f, r);
+                    out << fmt::format(
+                        "rule {} : t{} {}\n"
+                        "{{\n"
+                        "    meta:\n"
+                        "        weight = {}\n"
+                        "        family = \"f{}\"\n"
+                        "    strings:\n"
+                        "        $a = \"{}\"\n"
+                        "        $b = {{ 4D 5A ?? ?? {:02X} {:02X} 00 }}\n"
+                        "        $c = /z{}[0-9]{{2,4}}y/\n"
+                        "    condition:\n"
+                        "        any of them\n"
+                        "}}\n\n",
+                        name,
+                        r % 8,
+                        r % 3 == 0 ? "shared" : "",
+                        r % 10,
+                        r % 5,
+                        token,
+                        f,
+                        r,
+                        r);
+                    if (r % 16 == 0)
+                        p_corpus.identifiers.push_back(
+                            fmt::format("{}:{}", namespaces[n], name));
+                    p_corpus.tokens.push_back(token);
+                }
+            }
+        }
+
+        for (size_t t = 0; t < 8; ++t)
+        {
+            p_corpus.tags.push_back(fmt::format("t{}", t));
+        }
+        p_corpus.tags.emplace_back("shared");
+        p_corpus.sources.push_back({(p_corpus.root / "rules").string(), {}, {}});
+    }
+
+    /* random bytes with a few planted tokens, also written to disk */
+    std::vector<std::string> write_samples(const Settings &p_settings,
+                                           Corpus &p_corpus,
+                                           std::vector<std::string> &p_paths)
+    {
+        std::mt19937_64 random(0x5eed);
+        std::vector<std::string> samples(p_settings.samples);
+        const fs::path folder = p_corpus.root / "samples";
+        fs::create_directories(folder);
+
+        for (size_t i = 0; i < samples.size(); ++i)
+        {
+            std::string &sample = samples[i];
+            sample.resize(p_settings.sample_size);
+            for (char &c : sample)
+            {
+                c = static_cast<char>(random() & 0xff);
+            }
+
+            if (!p_corpus.tokens.empty() && sample.size() > 64)
+            {
+                for (size_t k = 0; k < 4; ++k)
+                {
+                    const std::string &token =
+                        p_corpus.tokens[random() % p_corpus.tokens.size()];
+                    const size_t at = random() % (sample.size() - 64);
+                    sample.replace(at, token.size(), token);
+                }
+            }
+
+            const fs::path path = folder / fmt::format("sample_{}.bin", i);
+            std::ofstream(path, std::ios::binary) << sample;
+            p_paths.push_back(path.string());
+        }
+        return samples;
+    }
+
+    int count_matches(YR_SCAN_CONTEXT *,
+                      int p_message,
+                      void *,
+                      void *p_user_data)
+    {
+        if (p_message == CALLBACK_MSG_RULE_MATCHING)
+            ++*static_cast<uint64_t *>(p_user_data);
+        return CALLBACK_CONTINUE;
+    }
+
+    uint64_t percentile(const std::vector<uint64_t> &p_sorted, double p_rank)
+    {
+        if (p_sorted.empty())
+            return 0;
+        const size_t at = std::min(
+            static_cast<size_t>(p_rank * static_cast<double>(p_sorted.size())),
+            p_sorted.size() - 1);
+        return p_sorted[at];
+    }
+
+    Step run_step(yara::Yara &p_yara,
+                  const Settings &p_settings,
+                  const Corpus &p_corpus,
+                  const std::vector<std::string> &p_samples,
+                  const std::vector<std::string> &p_paths,
+                  size_t p_threads)
+    {
+        Step step;
+        step.threads = p_threads;
+
+        std::atomic<bool> stop(false);
+        std::atomic<uint64_t> errors(0);
+        std::atomic<uint64_t> reloads(0);
+        std::atomic<uint64_t> toggles(0);
+        std::atomic<uint64_t> iterations(0);
+        std::vector<std::vector<uint64_t>> latencies(p_threads);
+
+        const auto scanner = [&](size_t p_id)
+        {
+            std::vector<uint64_t> &samples = latencies[p_id];
+            uint64_t matches = 0;
+            for (size_t n = p_id; !stop.load(std::memory_order_relaxed); ++n)
+            {
+                const size_t which = n % p_samples.size();
+                const auto started = std::chrono::steady_clock::now();
+                try
+                {
+                    // Every eighth scan goes through the file path
+                    if (n % 8 == 0)
+                    {
+                        p_yara.scan_file(p_paths[which],
+                                         &count_matches,
+                                         &matches,
+                                         yara::type::Flags::FastMode);
+                    }
+                    else
+                    {
+                        const std::string &sample = p_samples[which];
+                        p_yara.scan_mem(
+                            reinterpret_cast<const uint8_t *>(sample.data()),
+                            sample.size(),
+                            &count_matches,
+                            &matches,
+                            yara::type::Flags::FastMode);
+                    }
+                }
+                catch (const std::exception &e)
+                {
+                    if (errors++ == 0)
+                        fmt::print(stderr, "scan failed: {}\n", e.what());
+                    continue;
+                }
+                samples.push_back(static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - started)
+                        .count()));
+            }
+        };
+
+        const auto reloader = [&]()
+        {
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                try
+                {
+                    if (!p_yara.compiling())
+                    {
+                        p_yara.compile_async(p_corpus.sources);
+                        ++reloads;
+                    }
+                }
+                catch (const yara::exception::CompilerRules &)
+                {
+                    // A compile is still running, poll and try again
+                }
+                for (const auto &event : p_yara.compile_poll())
+                {
+                    if (event.type == yara::type::Failed)
+                    {
+                        ++errors;
+                        fmt::print(stderr, "reload failed: {}\n", event.message);
+                    }
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+        };
+
+        const auto toggler = [&]()
+        {
+            std::mt19937 random(static_cast<unsigned>(p_threads));
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                const bool disable = random() % 2 == 0;
+                const auto pick = [&](const std::vector<std::string> &p_from)
+                {
+                    return p_from.empty() ? std::string()
+                                          : p_from[random() % p_from.size()];
+                };
+
+                const yara::type::RuleKey key =
+                    static_cast<yara::type::RuleKey>(random() % 3);
+                const std::string name =
+                    key == yara::type::Identifier ? pick(p_corpus.identifiers)
+                    : key == yara::type::Tag      ? pick(p_corpus.tags)
+                                                  : pick(p_corpus.namespaces);
+                if (name.empty())
+                    continue;
+
+                (void)(disable ? p_yara.rules_disable(key, name)
+                               : p_yara.rules_enable(key, name));
+                ++toggles;
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+            p_yara.rules_toggled_clear();
+        };
+
+        const auto iterator = [&]()
+        {
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                size_t metas = 0;
+                p_yara.rules_foreach(
+                    [&](const YR_RULE &p_rule)
+                    {
+                        p_yara.metas_foreach(const_cast<YR_RULE *>(&p_rule),
+                                             [&](const YR_META &) { ++metas; });
+                    });
+                ++iterations;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(p_threads + 3);
+        for (size_t i = 0; i < p_threads; ++i)
+        {
+            threads.emplace_back(scanner, i);
+        }
+        if (!p_corpus.sources.empty())
+            threads.emplace_back(reloader);
+        if (!p_corpus.identifiers.empty() || !p_corpus.tags.empty())
+            threads.emplace_back(toggler);
+        threads.emplace_back(iterator);
+
+        const auto started = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(
+            std::chrono::duration<double>(p_settings.seconds));
+        stop.store(true);
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+        step.seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - started)
+                           .count();
+
+        // A reload may still run, wait for it so the next step starts clean
+        while (p_yara.compiling())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        (void)p_yara.compile_poll();
+
+        std::vector<uint64_t> all;
+        for (auto &samples : latencies)
+        {
+            all.insert(all.end(), samples.begin(), samples.end());
+        }
+        std::sort(all.begin(), all.end());
+
+        step.scans = all.size();
+        step.errors = errors.load();
+        step.reloads = reloads.load();
+        step.toggles = toggles.load();
+        step.iterations = iterations.load();
+        step.p50_ns = percentile(all, 0.50);
+        step.p99_ns = percentile(all, 0.99);
+        step.max_ns = all.empty() ? 0 : all.back();
+        return step;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const Settings settings = parse(argc, argv);
+
+    Corpus corpus;
+    corpus.root = fs::temp_directory_path() /
+                  fmt::format("yaral_stress_{}", static_cast<long>(getpid()));
+    fs::create_directories(corpus.root);
+
+    int status = 0;
+    try
+    {
+        if (settings.rules.empty())
+        {
+            write_corpus(corpus);
+        }
+        else
+        {
+            // Toggle targets are taken from the loaded rules below
+            corpus.sources.push_back({settings.rules, {}, {}});
+        }
+
+        std::vector<std::string> paths;
+        const std::vector<std::string> samples =
+            write_samples(settings, corpus, paths);
+
+        yara::Yara yara;
+        for (const auto &source : yara::Yara::collect_rules_folder(
+                 corpus.sources.front().path))
+        {
+            if (yara.set_rule_file(source.path,
+                                   fs::path(source.path).filename().string(),
+                                   source.ns) != ERROR_SUCCESS)
+            {
+                throw yara::exception::LoadRules("could not compile " +
+                                                 source.path);
+            }
+        }
+        yara.load_rules();
+
+        if (!settings.rules.empty())
+        {
+            yara.rules_foreach(
+                [&](const YR_RULE &p_rule)
+                {
+                    if (corpus.identifiers.size() < 64)
+                        corpus.identifiers.push_back(fmt::format(
+                            "{}:{}", p_rule.ns->name, p_rule.identifier));
+                    if (std::find(corpus.namespaces.begin(),
+                                  corpus.namespaces.end(),
+                                  p_rule.ns->name) == corpus.namespaces.end())
+                        corpus.namespaces.emplace_back(p_rule.ns->name);
+                });
+        }
+
+        fmt::print("{:>7} {:>10} {:>12} {:>11} {:>11} {:>11} {:>8} {:>8} "
+                   "{:>8} {:>6}\n",
+                   "threads",
+                   "scans",
+                   "scans/sec",
+                   "p50_us",
+                   "p99_us",
+                   "max_us",
+                   "reloads",
+                   "toggles",
+                   "iterate",
+                   "errors");
+
+        std::vector<size_t> counts;
+        for (size_t threads = 1; threads < settings.max_threads; threads *= 2)
+        {
+            counts.push_back(threads);
+        }
+        counts.push_back(settings.max_threads);
+
+        for (const size_t threads : counts)
+        {
+            const Step step =
+                run_step(yara, settings, corpus, samples, paths, threads);
+            fmt::print("{:>7} {:>10} {:>12.1f} {:>11.1f} {:>11.1f} {:>11.1f} "
+                       "{:>8} {:>8} {:>8} {:>6}\n",
+                       step.threads,
+                       step.scans,
+                       static_cast<double>(step.scans) / step.seconds,
+                       static_cast<double>(step.p50_ns) / 1e3,
+                       static_cast<double>(step.p99_ns) / 1e3,
+                       static_cast<double>(step.max_ns) / 1e3,
+                       step.reloads,
+                       step.toggles,
+                       step.iterations,
+                       step.errors);
+            if (step.errors != 0)
+                status = 1;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        fmt::print(stderr, "yaral_stress: {}\n", e.what());
+        status = 1;
+    }
+
+    std::error_code ignored;
+    fs::remove_all(corpus.root, ignored);
+    return status;
+}